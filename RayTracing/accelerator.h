@@ -0,0 +1,87 @@
+//
+//  accelerator.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef accelerator_h
+#define accelerator_h
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "objects.h"
+#include "ray_packet.h"
+
+enum AcceleratorType {
+    ACCELERATOR_KD_TREE,    // LinearKDTree
+    ACCELERATOR_BVH,        // BVH, binary nodes
+    ACCELERATOR_BVH4        // BVH4, four children per node
+};
+
+// Flat arrays of a built index, what the scene cache stores. The node layout
+// depends on the accelerator, objects are referred to by their position.
+struct AcceleratorData {
+    const void* nodes;
+    size_t nodeBytes;
+    const uint32_t* indices;
+    size_t indexCount;
+    BoundingBox bBox;           // bounds of the scene, only the KD-tree keeps them
+    
+    AcceleratorData() : nodes(NULL), nodeBytes(0), indices(NULL), indexCount(0),
+        bBox(Geometry::Point3D(0, 0, 0), Geometry::Point3D(0, 0, 0)) { }
+};
+
+// Copies the arrays of an AcceleratorData, false if they don't fit the objects
+template<class Node>
+bool loadArrays(const AcceleratorData& data, size_t objectCount, std::vector<Node>* nodes,
+                std::vector<uint32_t>* indices) {
+    if (data.nodeBytes % sizeof(Node) != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < data.indexCount; ++i) {
+        if (data.indices[i] >= objectCount) {
+            return false;
+        }
+    }
+    
+    const Node* first = (const Node*) data.nodes;
+    nodes->assign(first, first + data.nodeBytes / sizeof(Node));
+    indices->assign(data.indices, data.indices + data.indexCount);
+    return true;
+}
+
+// Spatial index over the objects of a scene, RayTracer only talks to this
+class Accelerator {
+public:
+    virtual ~Accelerator() { }
+    
+    // Replaces the index with one over the objects, the objects must outlive it
+    virtual void build(const std::vector<Object3D*>& objects, int threads) = 0;
+    
+    // Closest hit of the ray, tMax is moved to it. Nodes are clipped to the
+    // part of the ray before the closest hit so far.
+    virtual bool intersect(Geometry::Ray* ray, Object3D** crossObject) const = 0;
+    
+    // True if any object crosses the ray within [tMin, tMax]. Stops at the
+    // first hit found and never computes hit points.
+    virtual bool occluded(const Geometry::Ray& ray) const = 0;
+    
+    // Closest hits of all lanes of a coherent packet, see RayTracer::tracePacket
+    virtual void intersect(RayPacket* packet) const = 0;
+    
+    // The arrays point into the accelerator and live until the next build
+    virtual AcceleratorData data() const = 0;
+    
+    // Replaces the index with a copy of data() taken from the same kind of
+    // accelerator over the same objects, false if it doesn't fit them
+    virtual bool load(const AcceleratorData& data, const std::vector<Object3D*>& objects) = 0;
+    
+    virtual size_t memoryUsage() const = 0;
+    virtual void printMemoryReport(std::ostream& out) const = 0;
+};
+
+#endif /* accelerator_h */
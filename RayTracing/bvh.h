@@ -0,0 +1,303 @@
+//
+//  bvh.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef bvh_h
+#define bvh_h
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "accelerator.h"
+#include "bvh_builder.h"
+#include "traversal_stack.h"
+
+// 32 byte node of the flattened binary BVH. The left child of an inner node
+// always follows it in the array.
+struct BVHNode {
+    float low[3], high[3];      // rounded outwards
+    uint32_t offset;            // inner node: right child, leaf: first object index
+    uint16_t count;             // objects of a leaf, 0 for an inner node
+    uint16_t axis;              // inner node: split axis, orders the children
+    
+    bool isLeaf() const {
+        return count != 0;
+    }
+    
+    BoundingBox bBox() const {
+        return BoundingBox(Point3D(low[0], low[1], low[2]), Point3D(high[0], high[1], high[2]));
+    }
+    
+    // BoundingBox::clip() on the float bounds, without making the box
+    bool clip(const Ray& ray, Real* tNear, Real* tFar) const {
+        Real tmin = ray.tMin, tmax = ray.tMax;
+        for (int axis = 0; axis < 3; ++axis) {
+            const float* nearSide = ray.sign[axis] ? high : low;
+            const float* farSide  = ray.sign[axis] ? low : high;
+            tmin = std::max(tmin, (nearSide[axis] - ray.origin[axis]) * ray.inv[axis]);
+            tmax = std::min(tmax, (farSide [axis] - ray.origin[axis]) * ray.inv[axis]);
+        }
+        *tNear = tmin;
+        *tFar = tmax;
+        return tmin <= tmax;
+    }
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode has to stay 32 bytes");
+
+// Binary BVH in one array in depth first order, all leaves share one array
+// of object indices
+class BVH : public Accelerator {
+public:
+    virtual void build(const std::vector<Object3D*>& objects, int threads) {
+        nodes_.clear();
+        indices_.clear();
+        objects_ = objects;
+        if (objects.empty()) {
+            return;
+        }
+        
+        BVHBuilder builder;
+        BVHBuildNode* root = builder.build(objects, threads);
+        flatten(root, builder.order());
+        delete root;
+    }
+    
+    virtual bool intersect(Ray* ray, Object3D** crossObject) const
+    {
+        *crossObject = NULL;
+        
+        struct Entry {
+            uint32_t node;
+            Real tNear, tFar;
+        };
+        TraversalStack<Entry, TRAVERSAL_DEPTH> stack;
+        
+        Entry current = {0, 0, 0};
+        if (nodes_.empty() || !nodes_[0].clip(*ray, &current.tNear, &current.tFar)) {
+            return false;
+        }
+        
+        while (true) {
+            const BVHNode& node = nodes_[current.node];
+            
+            if (node.isLeaf()) {
+                for (uint32_t i = 0; i < node.count; ++i) {
+                    Object3D* object = objects_[indices_[node.offset + i]];
+                    if (object->intersect(ray)) {
+                        *crossObject = object;
+                    }
+                }
+            } else {
+                // Children behind the closest hit so far are clipped away
+                Entry left = {current.node + 1, 0, 0}, right = {node.offset, 0, 0};
+                bool hitLeft = nodes_[left.node].clip(*ray, &left.tNear, &left.tFar);
+                bool hitRight = nodes_[right.node].clip(*ray, &right.tNear, &right.tFar);
+                
+                if (hitLeft && hitRight) {
+                    // The nearer child first, the other one may be pruned by its hit
+                    if (right.tNear < left.tNear) {
+                        std::swap(left, right);
+                    }
+                    stack.push(right);
+                    current = left;
+                    continue;
+                } else if (hitLeft || hitRight) {
+                    current = hitLeft ? left : right;
+                    continue;
+                }
+            }
+            
+            do {
+                if (stack.empty()) {
+                    return *crossObject != NULL;
+                }
+                current = stack.pop();
+            } while (current.tNear > ray->tMax);
+        }
+    }
+    
+    virtual bool occluded(const Ray& ray) const {
+        if (nodes_.empty()) {
+            return false;
+        }
+        
+        TraversalStack<uint32_t, TRAVERSAL_DEPTH> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t index = stack.pop();
+            const BVHNode& node = nodes_[index];
+            
+            Real tNear, tFar;
+            if (!node.clip(ray, &tNear, &tFar)) {
+                continue;
+            }
+            
+            if (node.isLeaf()) {
+                for (uint32_t i = 0; i < node.count; ++i) {
+                    if (objects_[indices_[node.offset + i]]->occludes(ray)) {
+                        return true;
+                    }
+                }
+            } else {
+                // Front to back along the split axis
+                bool positive = ray.direction[node.axis] > 0;
+                stack.push(positive ? node.offset : index + 1);
+                stack.push(positive ? index + 1 : node.offset);
+            }
+        }
+        return false;
+    }
+    
+    virtual void intersect(RayPacket* packet) const {
+        const int SIZE = RayPacket::SIZE;
+        if (nodes_.empty()) {
+            return;
+        }
+        
+        TraversalStack<uint32_t, TRAVERSAL_DEPTH> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t index = stack.pop();
+            const BVHNode& node = nodes_[index];
+            
+            Real tNear[SIZE], tFar[SIZE];
+            bool active[SIZE];
+            node.bBox().intersect(*packet, tNear, tFar);
+            
+            bool any = false;
+            for (int i = 0; i < SIZE; ++i) {
+                active[i] = i < packet->count && tNear[i] <= tFar[i] && tNear[i] <= packet->t[i];
+                any = any || active[i];
+            }
+            if (!any) {
+                continue;
+            }
+            
+            if (node.isLeaf()) {
+                for (uint32_t k = 0; k < node.count; ++k) {
+                    objects_[indices_[node.offset + k]]->intersectPacket(packet, tNear, tFar, active);
+                }
+            } else {
+                // Coherent lanes agree on the direction along the split axis
+                bool positive = packet->d[node.axis][0] > 0;
+                stack.push(positive ? node.offset : index + 1);
+                stack.push(positive ? index + 1 : node.offset);
+            }
+        }
+    }
+    
+    virtual AcceleratorData data() const {
+        AcceleratorData data;
+        data.nodes = nodes_.data();
+        data.nodeBytes = nodes_.size() * sizeof(BVHNode);
+        data.indices = indices_.data();
+        data.indexCount = indices_.size();
+        return data;
+    }
+    
+    virtual bool load(const AcceleratorData& data, const std::vector<Object3D*>& objects) {
+        if (!loadArrays(data, objects.size(), &nodes_, &indices_) || !validTree()) {
+            nodes_.clear();
+            indices_.clear();
+            return false;
+        }
+        objects_ = objects;
+        return true;
+    }
+    
+    virtual size_t memoryUsage() const {
+        return nodes_.size() * sizeof(BVHNode) + indices_.size() * sizeof(uint32_t);
+    }
+    
+    virtual void printMemoryReport(std::ostream& out) const {
+        size_t leaves = 0;
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            leaves += nodes_[i].isLeaf();
+        }
+        
+        out << "BVH: " << nodes_.size() << " nodes, " << leaves << " leaves, "
+            << indices_.size() << " object references" << std::endl;
+        out << "  layout: " << memoryUsage() << " bytes ("
+            << nodes_.size() * sizeof(BVHNode) << " in nodes, "
+            << indices_.size() * sizeof(uint32_t) << " in object indices)" << std::endl;
+    }
+    
+private:
+    std::vector<BVHNode> nodes_;
+    std::vector<uint32_t> indices_;
+    std::vector<Object3D*> objects_;
+    
+    // The walks trust the arrays, a loaded copy is checked once: every child
+    // follows its parent, no node is reached twice, inner nodes fit the
+    // traversal stack, split axes are axes and every leaf slice lies within
+    // indices_
+    bool validTree() const {
+        struct Pending {
+            uint32_t node;
+            int depth;
+        };
+        std::vector<Pending> pending;
+        if (!nodes_.empty()) {
+            Pending root = {0, 0};
+            pending.push_back(root);
+        }
+        size_t visited = 0;
+        while (!pending.empty()) {
+            uint32_t index = pending.back().node;
+            int depth = pending.back().depth;
+            pending.pop_back();
+            if (index >= nodes_.size() || ++visited > nodes_.size()) {
+                return false;
+            }
+            
+            const BVHNode& node = nodes_[index];
+            if (node.isLeaf()) {
+                if ((uint64_t) node.offset + node.count > indices_.size()) {
+                    return false;
+                }
+            } else {
+                if (node.offset <= index + 1 || node.axis > 2 || depth >= TRAVERSAL_DEPTH) {
+                    return false;
+                }
+                Pending left = {index + 1, depth + 1}, right = {node.offset, depth + 1};
+                pending.push_back(left);
+                pending.push_back(right);
+            }
+        }
+        return true;
+    }
+    
+    void flatten(const BVHBuildNode* node, const std::vector<uint32_t>& order) {
+        uint32_t index = (uint32_t) nodes_.size();
+        nodes_.push_back(BVHNode());
+        for (int axis = 0; axis < 3; ++axis) {
+            nodes_[index].low[axis] = roundDown(node->bBox.low(axis));
+            nodes_[index].high[axis] = roundUp(node->bBox.high(axis));
+        }
+        
+        if (node->isLeaf()) {
+            nodes_[index].offset = (uint32_t) indices_.size();
+            assert(node->count <= UINT16_MAX);
+            nodes_[index].count = (uint16_t) node->count;
+            nodes_[index].axis = 0;
+            indices_.insert(indices_.end(), order.begin() + node->first, order.begin() + node->first + node->count);
+            return;
+        }
+        
+        nodes_[index].count = 0;
+        nodes_[index].axis = (uint16_t) node->axis;
+        flatten(node->children[0], order);
+        nodes_[index].offset = (uint32_t) nodes_.size();
+        flatten(node->children[1], order);
+    }
+};
+
+#endif /* bvh_h */
@@ -0,0 +1,403 @@
+//
+//  bvh4.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef bvh4_h
+#define bvh4_h
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "accelerator.h"
+#include "bvh_builder.h"
+#include "traversal_stack.h"
+
+// 128 byte node with up to four children. The bounds of the children are
+// stored as structure of arrays, so one ray is tested against all four boxes
+// by fixed length loops the compiler turns into vector code.
+struct BVH4Node {
+    static const int WIDTH = 4;
+    static const uint32_t EMPTY = 0xFFFFFFFF;
+    
+    // Unused slots hold a point box at FLT_MAX: infinite bounds would be
+    // simpler, but x87 long double arithmetic on infinities is very slow
+    float low[3][WIDTH], high[3][WIDTH];    // rounded outwards
+    uint32_t child[WIDTH];                  // inner child: node index, leaf child: first object index
+    uint32_t count[WIDTH];                  // objects of a leaf child, 0 for an inner child, EMPTY if unused
+    
+    // Slab test of the ray against all children, a child is missed if
+    // tNear > tFar. The sign bits of the ray pick the near and far planes.
+    void intersect(const Ray& ray, Real* tNear, Real* tFar) const {
+        for (int k = 0; k < WIDTH; ++k) {
+            tNear[k] = ray.tMin;
+            tFar[k] = ray.tMax;
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            const float* nearSide = ray.sign[axis] ? high[axis] : low[axis];
+            const float* farSide  = ray.sign[axis] ? low[axis] : high[axis];
+            Real origin = ray.origin[axis], inv = ray.inv[axis];
+            for (int k = 0; k < WIDTH; ++k) {
+                tNear[k] = std::max(tNear[k], (nearSide[k] - origin) * inv);
+                tFar[k]  = std::min(tFar[k],  (farSide [k] - origin) * inv);
+            }
+        }
+    }
+    
+    BoundingBox bBox(int k) const {
+        return BoundingBox(Point3D(low[0][k], low[1][k], low[2][k]), Point3D(high[0][k], high[1][k], high[2][k]));
+    }
+};
+
+static_assert(sizeof(BVH4Node) == 128, "BVH4Node has to stay 128 bytes");
+
+// BVH with four children per node, collapsed from the binary tree of
+// BVHBuilder by pulling up the grandchildren of the largest inner children.
+// Half the levels of the binary tree, four box tests per node visit.
+class BVH4 : public Accelerator {
+public:
+    virtual void build(const std::vector<Object3D*>& objects, int threads) {
+        nodes_.clear();
+        indices_.clear();
+        objects_ = objects;
+        if (objects.empty()) {
+            return;
+        }
+        
+        BVHBuilder builder;
+        BVHBuildNode* root = builder.build(objects, threads);
+        collapse(root, builder.order());
+        delete root;
+    }
+    
+    virtual bool intersect(Ray* ray, Object3D** crossObject) const
+    {
+        const int WIDTH = BVH4Node::WIDTH;
+        *crossObject = NULL;
+        if (nodes_.empty()) {
+            return false;
+        }
+        
+        struct Entry {
+            uint32_t child, count;
+            Real tNear, tFar;
+        };
+        // A visit leaves at most three siblings per level on the stack and
+        // pushes the child it goes on with on top
+        TraversalStack<Entry, 3 * TRAVERSAL_DEPTH + 1> stack;
+        
+        Entry current = {0, 0, 0, 0};
+        while (true) {
+            if (current.count == 0) {
+                const BVH4Node& node = nodes_[current.child];
+                Real tNear[WIDTH], tFar[WIDTH];
+                node.intersect(*ray, tNear, tFar);
+                
+                // Hit children go on the stack farthest first, the ones behind
+                // the closest hit so far are already clipped away
+                Entry hits[WIDTH];
+                int hitCount = 0;
+                for (int k = 0; k < WIDTH; ++k) {
+                    if (node.count[k] != BVH4Node::EMPTY && tNear[k] <= tFar[k]) {
+                        Entry entry = {node.child[k], node.count[k], tNear[k], tFar[k]};
+                        hits[hitCount++] = entry;
+                    }
+                }
+                for (int k = 1; k < hitCount; ++k) {
+                    for (int j = k; j > 0 && hits[j - 1].tNear < hits[j].tNear; --j) {
+                        std::swap(hits[j - 1], hits[j]);
+                    }
+                }
+                stack.push(hits, hitCount);
+            } else {
+                for (uint32_t i = 0; i < current.count; ++i) {
+                    Object3D* object = objects_[indices_[current.child + i]];
+                    if (object->intersect(ray)) {
+                        *crossObject = object;
+                    }
+                }
+            }
+            
+            do {
+                if (stack.empty()) {
+                    return *crossObject != NULL;
+                }
+                current = stack.pop();
+            } while (current.tNear > ray->tMax);
+        }
+    }
+    
+    virtual bool occluded(const Ray& ray) const {
+        const int WIDTH = BVH4Node::WIDTH;
+        if (nodes_.empty()) {
+            return false;
+        }
+        
+        struct Entry {
+            uint32_t child, count;
+            Real tNear, tFar;
+        };
+        TraversalStack<Entry, 3 * TRAVERSAL_DEPTH + 1> stack;
+        
+        Entry current = {0, 0, 0, 0};
+        while (true) {
+            if (current.count == 0) {
+                const BVH4Node& node = nodes_[current.child];
+                Real tNear[WIDTH], tFar[WIDTH];
+                node.intersect(ray, tNear, tFar);
+                
+                // Nearest on top, an early hit saves the rest
+                Entry hits[WIDTH];
+                int hitCount = 0;
+                for (int k = 0; k < WIDTH; ++k) {
+                    if (node.count[k] != BVH4Node::EMPTY && tNear[k] <= tFar[k]) {
+                        Entry entry = {node.child[k], node.count[k], tNear[k], tFar[k]};
+                        hits[hitCount++] = entry;
+                    }
+                }
+                for (int k = 1; k < hitCount; ++k) {
+                    for (int j = k; j > 0 && hits[j - 1].tNear < hits[j].tNear; --j) {
+                        std::swap(hits[j - 1], hits[j]);
+                    }
+                }
+                stack.push(hits, hitCount);
+            } else {
+                for (uint32_t i = 0; i < current.count; ++i) {
+                    if (objects_[indices_[current.child + i]]->occludes(ray)) {
+                        return true;
+                    }
+                }
+            }
+            
+            if (stack.empty()) {
+                return false;
+            }
+            current = stack.pop();
+        }
+    }
+    
+    virtual void intersect(RayPacket* packet) const {
+        const int SIZE = RayPacket::SIZE;
+        const int WIDTH = BVH4Node::WIDTH;
+        if (nodes_.empty()) {
+            return;
+        }
+        
+        struct Entry {
+            uint32_t child, count;
+            Real tNear[SIZE], tFar[SIZE];
+        };
+        TraversalStack<Entry, 3 * TRAVERSAL_DEPTH + 1> stack;
+        
+        Entry current;
+        current.child = 0;
+        current.count = 0;
+        while (true) {
+            if (current.count == 0) {
+                const BVH4Node& node = nodes_[current.child];
+                
+                Entry hits[WIDTH];
+                Real order[WIDTH];
+                int hitCount = 0;
+                for (int k = 0; k < WIDTH && node.count[k] != BVH4Node::EMPTY; ++k) {
+                    Entry& entry = hits[hitCount];
+                    entry.child = node.child[k];
+                    entry.count = node.count[k];
+                    node.bBox(k).intersect(*packet, entry.tNear, entry.tFar);
+                    
+                    bool any = false;
+                    order[hitCount] = std::numeric_limits<Real>::infinity();
+                    for (int i = 0; i < packet->count; ++i) {
+                        bool hit = entry.tNear[i] <= entry.tFar[i] && entry.tNear[i] <= packet->t[i];
+                        any = any || hit;
+                        order[hitCount] = hit ? std::min(order[hitCount], entry.tNear[i]) : order[hitCount];
+                    }
+                    hitCount += any;
+                }
+                
+                // Farthest first, so the nearest child is visited next
+                for (int k = 0; k < hitCount; ++k) {
+                    int farthest = k;
+                    for (int j = k + 1; j < hitCount; ++j) {
+                        farthest = order[j] > order[farthest] ? j : farthest;
+                    }
+                    std::swap(hits[k], hits[farthest]);
+                    std::swap(order[k], order[farthest]);
+                    stack.push(hits[k]);
+                }
+            } else {
+                bool active[SIZE];
+                for (int i = 0; i < SIZE; ++i) {
+                    active[i] = i < packet->count && current.tNear[i] <= current.tFar[i] &&
+                                current.tNear[i] <= packet->t[i];
+                }
+                for (uint32_t k = 0; k < current.count; ++k) {
+                    objects_[indices_[current.child + k]]->intersectPacket(packet, current.tNear, current.tFar, active);
+                }
+            }
+            
+            if (stack.empty()) {
+                break;
+            }
+            current = stack.pop();
+        }
+    }
+    
+    virtual AcceleratorData data() const {
+        AcceleratorData data;
+        data.nodes = nodes_.data();
+        data.nodeBytes = nodes_.size() * sizeof(BVH4Node);
+        data.indices = indices_.data();
+        data.indexCount = indices_.size();
+        return data;
+    }
+    
+    virtual bool load(const AcceleratorData& data, const std::vector<Object3D*>& objects) {
+        if (!loadArrays(data, objects.size(), &nodes_, &indices_) || !validTree()) {
+            nodes_.clear();
+            indices_.clear();
+            return false;
+        }
+        objects_ = objects;
+        return true;
+    }
+    
+    virtual size_t memoryUsage() const {
+        return nodes_.size() * sizeof(BVH4Node) + indices_.size() * sizeof(uint32_t);
+    }
+    
+    virtual void printMemoryReport(std::ostream& out) const {
+        size_t leaves = 0, slots = 0;
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            for (int k = 0; k < BVH4Node::WIDTH; ++k) {
+                leaves += nodes_[i].count[k] != 0 && nodes_[i].count[k] != BVH4Node::EMPTY;
+                slots += nodes_[i].count[k] != BVH4Node::EMPTY;
+            }
+        }
+        
+        out << "BVH4: " << nodes_.size() << " nodes, " << leaves << " leaves, "
+            << indices_.size() << " object references, "
+            << (nodes_.empty() ? 0 : 100 * slots / (nodes_.size() * BVH4Node::WIDTH)) << "% of slots used" << std::endl;
+        out << "  layout: " << memoryUsage() << " bytes ("
+            << nodes_.size() * sizeof(BVH4Node) << " in nodes, "
+            << indices_.size() * sizeof(uint32_t) << " in object indices)" << std::endl;
+    }
+    
+private:
+    std::vector<BVH4Node> nodes_;
+    std::vector<uint32_t> indices_;
+    std::vector<Object3D*> objects_;
+    
+    // The walks trust the arrays, a loaded copy is checked once: every inner
+    // child follows its parent, no node is reached twice, inner nodes fit the
+    // traversal stack and every leaf slice lies within indices_
+    bool validTree() const {
+        struct Pending {
+            uint32_t node;
+            int depth;
+        };
+        std::vector<Pending> pending;
+        if (!nodes_.empty()) {
+            Pending root = {0, 0};
+            pending.push_back(root);
+        }
+        size_t visited = 0;
+        while (!pending.empty()) {
+            uint32_t index = pending.back().node;
+            int depth = pending.back().depth;
+            pending.pop_back();
+            if (index >= nodes_.size() || ++visited > nodes_.size()) {
+                return false;
+            }
+            
+            if (depth >= TRAVERSAL_DEPTH) {
+                return false;
+            }
+            
+            const BVH4Node& node = nodes_[index];
+            for (int k = 0; k < BVH4Node::WIDTH; ++k) {
+                if (node.count[k] == BVH4Node::EMPTY) {
+                    continue;
+                }
+                if (node.count[k] != 0) {
+                    if ((uint64_t) node.child[k] + node.count[k] > indices_.size()) {
+                        return false;
+                    }
+                } else if (node.child[k] <= index) {
+                    return false;
+                } else {
+                    Pending child = {node.child[k], depth + 1};
+                    pending.push_back(child);
+                }
+            }
+        }
+        return true;
+    }
+    
+    // Emits the node holding the children of the binary node (the node
+    // itself if the root is a leaf) and returns its index
+    uint32_t collapse(const BVHBuildNode* node, const std::vector<uint32_t>& order) {
+        std::vector<const BVHBuildNode*> children;
+        if (node->isLeaf()) {
+            children.push_back(node);
+        } else {
+            children.push_back(node->children[0]);
+            children.push_back(node->children[1]);
+        }
+        
+        while (children.size() < BVH4Node::WIDTH) {
+            int largest = -1;
+            for (int k = 0; k < (int) children.size(); ++k) {
+                if (!children[k]->isLeaf() &&
+                    (largest < 0 || children[k]->bBox.surfaceArea() > children[largest]->bBox.surfaceArea())) {
+                    largest = k;
+                }
+            }
+            if (largest < 0) {
+                break;
+            }
+            
+            const BVHBuildNode* inner = children[largest];
+            children[largest] = inner->children[0];
+            children.insert(children.begin() + largest + 1, inner->children[1]);
+        }
+        
+        uint32_t index = (uint32_t) nodes_.size();
+        nodes_.push_back(BVH4Node());
+        for (int k = 0; k < BVH4Node::WIDTH; ++k) {
+            for (int axis = 0; axis < 3; ++axis) {
+                nodes_[index].low[axis][k] = std::numeric_limits<float>::max();
+                nodes_[index].high[axis][k] = std::numeric_limits<float>::max();
+            }
+            nodes_[index].child[k] = 0;
+            nodes_[index].count[k] = BVH4Node::EMPTY;
+        }
+        
+        for (int k = 0; k < (int) children.size(); ++k) {
+            const BVHBuildNode* child = children[k];
+            for (int axis = 0; axis < 3; ++axis) {
+                nodes_[index].low[axis][k] = roundDown(child->bBox.low(axis));
+                nodes_[index].high[axis][k] = roundUp(child->bBox.high(axis));
+            }
+            
+            if (child->isLeaf()) {
+                nodes_[index].child[k] = (uint32_t) indices_.size();
+                nodes_[index].count[k] = child->count;
+                indices_.insert(indices_.end(), order.begin() + child->first, order.begin() + child->first + child->count);
+            } else {
+                uint32_t childIndex = collapse(child, order);
+                nodes_[index].child[k] = childIndex;
+                nodes_[index].count[k] = 0;
+            }
+        }
+        return index;
+    }
+};
+
+#endif /* bvh4_h */
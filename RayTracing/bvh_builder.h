@@ -0,0 +1,244 @@
+//
+//  bvh_builder.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef bvh_builder_h
+#define bvh_builder_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <vector>
+
+#include "kdTree.h"
+#include "traversal_stack.h"
+
+// Nearest floats below and above a value, flattened BVH nodes store their
+// bounds as floats and must still contain everything inside
+inline float roundDown(Real value) {
+    float result = (float) value;
+    return result > value ? std::nextafter(result, -std::numeric_limits<float>::infinity()) : result;
+}
+
+inline float roundUp(Real value) {
+    float result = (float) value;
+    return result < value ? std::nextafter(result, std::numeric_limits<float>::infinity()) : result;
+}
+
+// Binary node of the BVH under construction, BVH and BVH4 flatten it
+struct BVHBuildNode {
+    BoundingBox bBox;
+    BVHBuildNode* children[2];
+    uint32_t first, count;      // leaf: slice of BVHBuilder::order()
+    int axis;                   // inner node: axis the children were split on
+    
+    BVHBuildNode(const BoundingBox& bBox) : bBox(bBox), first(0), count(0), axis(-1) {
+        children[0] = children[1] = NULL;
+    }
+    
+    ~BVHBuildNode() {
+        delete children[0];
+        delete children[1];
+    }
+    
+    bool isLeaf() const {
+        return children[0] == NULL;
+    }
+};
+
+// Top down BVH builder. Every node bins the centers of its objects into
+// BINS buckets per axis and takes the split with the lowest SAH cost, with
+// the same C_I and C_T as the KD-tree. Unlike the KD-tree every object ends
+// up in exactly one leaf, so large objects are never duplicated.
+class BVHBuilder {
+public:
+    static const int BINS = 16;
+    static const int LEAF_SIZE = 8;
+    
+    // Leaves take at most UINT16_MAX objects, BVHNode counts them in 16 bits
+    BVHBuilder(int maxLeafSize = LEAF_SIZE) : maxLeafSize_(std::min(std::max(1, maxLeafSize), (int) UINT16_MAX)) { }
+    
+    // The tree is owned by the caller. Big subtrees are built as separate
+    // tasks, the result doesn't depend on the number of threads.
+    BVHBuildNode* build(const std::vector<Object3D*>& objects, int threads) {
+        boxes_.assign(objects.size(), BoundingBox(Point3D(0, 0, 0), Point3D(0, 0, 0)));
+        centers_.resize(objects.size());
+        order_.resize(objects.size());
+        
+        int slices = objects.size() >= KD_PARALLEL_OBJECTS ? std::max(1, threads) : 1;
+        parallelSlices(objects.size(), slices, [&](int /*slice*/, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                boxes_[i] = objects[i]->boundingBox();
+                centers_[i] = (boxes_[i].low() + boxes_[i].high()) / 2;
+                order_[i] = (uint32_t) i;
+            }
+        });
+        
+        return build(0, (uint32_t) objects.size(), threads, 0);
+    }
+    
+    // Object indices, every leaf owns a contiguous slice
+    const std::vector<uint32_t>& order() const {
+        return order_;
+    }
+    
+private:
+    int maxLeafSize_;
+    std::vector<BoundingBox> boxes_;
+    std::vector<Point3D> centers_;
+    std::vector<uint32_t> order_;
+    
+    BVHBuildNode* build(uint32_t begin, uint32_t end, int threads, int depth) {
+        BoundingBox bBox = boxes_[order_[begin]];
+        BoundingBox centers(centers_[order_[begin]], centers_[order_[begin]]);
+        for (uint32_t i = begin + 1; i < end; ++i) {
+            bBox.expand(boxes_[order_[i]]);
+            centers.expand(BoundingBox(centers_[order_[i]], centers_[order_[i]]));
+        }
+        
+        BVHBuildNode* node = new BVHBuildNode(bBox);
+        node->first = begin;
+        node->count = end - begin;
+        // The deepest level keeps whatever is left, the traversal stacks hold
+        // TRAVERSAL_DEPTH entries
+        if (node->count == 1 || depth + 1 >= TRAVERSAL_DEPTH) {
+            return node;
+        }
+        
+        // Near the depth limit a SAH split could cut off a few objects per
+        // level and leave too many for a leaf, a node is halved instead once
+        // halving is the only way left to get down to UINT16_MAX per leaf
+        int levels = TRAVERSAL_DEPTH - 1 - depth;
+        bool crowded = levels <= 32 && node->count > ((uint64_t) UINT16_MAX << (levels - 1));
+        
+        int axis;
+        uint32_t middle;
+        if (crowded || !findSplit(begin, end, bBox, centers, &axis, &middle)) {
+            if (!crowded && (int) node->count <= maxLeafSize_) {
+                return node;
+            }
+            // Too many objects for a leaf, halve them along the widest axis
+            axis = 0;
+            for (int k = 1; k < 3; ++k) {
+                if (centers.length(k) > centers.length(axis)) {
+                    axis = k;
+                }
+            }
+            middle = begin + node->count / 2;
+            std::nth_element(order_.begin() + begin, order_.begin() + middle, order_.begin() + end,
+                             [&](uint32_t a, uint32_t b) {
+                return centers_[a][axis] < centers_[b][axis] || (centers_[a][axis] == centers_[b][axis] && a < b);
+            });
+        }
+        
+        node->axis = axis;
+        node->count = 0;
+        
+        // The halves of order_ don't overlap, so the subtrees can be built at the same time
+        if (threads > 1 && end - middle >= KD_TASK_OBJECTS) {
+            std::future<BVHBuildNode*> right = std::async(std::launch::async, [=]() {
+                return build(middle, end, threads - threads / 2, depth + 1);
+            });
+            node->children[0] = build(begin, middle, threads / 2, depth + 1);
+            node->children[1] = right.get();
+        } else {
+            node->children[0] = build(begin, middle, threads, depth + 1);
+            node->children[1] = build(middle, end, threads, depth + 1);
+        }
+        return node;
+    }
+    
+    // Binned SAH over the object centers, partitions order_ at *middle on success
+    bool findSplit(uint32_t begin, uint32_t end, const BoundingBox& bBox, const BoundingBox& centers,
+                   int* bestAxis, uint32_t* middle) {
+        uint32_t count = end - begin;
+        Real area = bBox.surfaceArea();
+        Real bestCost = C_I * count;
+        int bestBin = -1;
+        *bestAxis = -1;
+        
+        for (int axis = 0; axis < 3; ++axis) {
+            Real extent = centers.length(axis);
+            if (!(extent > 0) || !(area > 0)) {
+                continue;
+            }
+            
+            int binCount[BINS] = {0};
+            std::vector<BoundingBox> binBox(BINS, BoundingBox(Point3D(0, 0, 0), Point3D(0, 0, 0)));
+            for (uint32_t i = begin; i < end; ++i) {
+                int bin = this->bin(centers_[order_[i]][axis], centers.low(axis), extent);
+                if (binCount[bin]++ == 0) {
+                    binBox[bin] = boxes_[order_[i]];
+                } else {
+                    binBox[bin].expand(boxes_[order_[i]]);
+                }
+            }
+            
+            // Areas and counts of everything right of each bin border
+            Real rightArea[BINS];
+            int rightCount[BINS];
+            BoundingBox right = binBox[BINS - 1];
+            int counted = 0;
+            for (int b = BINS - 1; b > 0; --b) {
+                if (binCount[b] > 0) {
+                    if (counted == 0) {
+                        right = binBox[b];
+                    } else {
+                        right.expand(binBox[b]);
+                    }
+                    counted += binCount[b];
+                }
+                rightArea[b] = counted > 0 ? right.surfaceArea() : 0;
+                rightCount[b] = counted;
+            }
+            
+            BoundingBox left = binBox[0];
+            counted = 0;
+            for (int b = 0; b < BINS - 1; ++b) {
+                if (binCount[b] > 0) {
+                    if (counted == 0) {
+                        left = binBox[b];
+                    } else {
+                        left.expand(binBox[b]);
+                    }
+                    counted += binCount[b];
+                }
+                if (counted == 0 || rightCount[b + 1] == 0) {
+                    continue;
+                }
+                
+                Real cost = C_T + C_I * (left.surfaceArea() * counted + rightArea[b + 1] * rightCount[b + 1]) / area;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    *bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+        
+        if (*bestAxis < 0) {
+            return false;
+        }
+        
+        int axis = *bestAxis;
+        Real low = centers.low(axis), extent = centers.length(axis);
+        uint32_t* split = std::partition(order_.data() + begin, order_.data() + end, [&](uint32_t i) {
+            return bin(centers_[i][axis], low, extent) <= bestBin;
+        });
+        *middle = (uint32_t) (split - order_.data());
+        return true;
+    }
+    
+    static int bin(Real center, Real low, Real extent) {
+        int bin = (int) ((center - low) / extent * BINS);
+        return std::min(std::max(bin, 0), BINS - 1);
+    }
+};
+
+#endif /* bvh_builder_h */
@@ -0,0 +1,261 @@
+//
+//  framebuffer.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef framebuffer_h
+#define framebuffer_h
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include "vec3.h"
+
+// Contiguous RGBA pixel buffer, rows top to bottom, 4 floats per pixel.
+// Rendering writes here; the SDL window and the image writers only read it.
+class Framebuffer {
+public:
+    Framebuffer() : width_(0), height_(0) { }
+    Framebuffer(int width, int height) {
+        resize(width, height);
+    }
+    
+    void resize(int width, int height) {
+        width_ = width;
+        height_ = height;
+        pixels_.assign((size_t) width * height * 4, 0.0f);
+    }
+    
+    int width() const {
+        return width_;
+    }
+    
+    int height() const {
+        return height_;
+    }
+    
+    void setPixel(int x, int y, const Geometry::Vec3& color) {
+        float* pixel = &pixels_[index(x, y)];
+        pixel[0] = (float) color[0];
+        pixel[1] = (float) color[1];
+        pixel[2] = (float) color[2];
+        pixel[3] = 1.0f;
+    }
+    
+    Geometry::Vec3 pixel(int x, int y) const {
+        const float* pixel = &pixels_[index(x, y)];
+        return Geometry::Vec3(pixel[0], pixel[1], pixel[2]);
+    }
+    
+    const float* data() const {
+        return pixels_.data();
+    }
+    
+    // 8 bit RGBA, same quantization as Geometry::makeRGBA
+    void toRGBA8(std::vector<uint8_t>* rgba) const {
+        rgba->resize(pixels_.size());
+        for (size_t i = 0; i < pixels_.size(); ++i) {
+            float value = pixels_[i] > 0 ? std::min(1.0f, pixels_[i]) : 0.0f;
+            (*rgba)[i] = static_cast<uint8_t>(value * 255);
+        }
+    }
+    
+    // Picks the format by extension: .ppm, .pfm or .png
+    bool write(const std::string& path) const {
+        std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        
+        if (ext == ".ppm") {
+            return writePPM(path);
+        } else if (ext == ".pfm") {
+            return writePFM(path);
+        } else if (ext == ".png") {
+            return writePNG(path);
+        }
+        printf("Unknown image format: %s\n", path.c_str());
+        return false;
+    }
+    
+    bool writePPM(const std::string& path) const {
+        std::vector<uint8_t> rgba;
+        toRGBA8(&rgba);
+        
+        std::vector<uint8_t> rgb((size_t) width_ * height_ * 3);
+        for (size_t i = 0, j = 0; i < rgba.size(); i += 4, j += 3) {
+            rgb[j] = rgba[i];
+            rgb[j + 1] = rgba[i + 1];
+            rgb[j + 2] = rgba[i + 2];
+        }
+        
+        FILE* file = open(path);
+        if (file == NULL) {
+            return false;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width_, height_);
+        fwrite(rgb.data(), 1, rgb.size(), file);
+        return close(file, path);
+    }
+    
+    // Portable float map, rows are stored bottom to top
+    bool writePFM(const std::string& path) const {
+        FILE* file = open(path);
+        if (file == NULL) {
+            return false;
+        }
+        
+        uint16_t probe = 1;
+        bool littleEndian = *reinterpret_cast<uint8_t*>(&probe) == 1;
+        fprintf(file, "PF\n%d %d\n%s\n", width_, height_, littleEndian ? "-1.0" : "1.0");
+        
+        std::vector<float> row((size_t) width_ * 3);
+        for (int y = height_ - 1; y >= 0; --y) {
+            for (int x = 0; x < width_; ++x) {
+                const float* pixel = &pixels_[index(x, y)];
+                row[3 * x] = pixel[0];
+                row[3 * x + 1] = pixel[1];
+                row[3 * x + 2] = pixel[2];
+            }
+            fwrite(row.data(), sizeof(float), row.size(), file);
+        }
+        return close(file, path);
+    }
+    
+    // 8 bit RGBA PNG with uncompressed (stored) deflate blocks
+    bool writePNG(const std::string& path) const {
+        std::vector<uint8_t> rgba;
+        toRGBA8(&rgba);
+        
+        // Scanlines with filter type 0
+        size_t stride = (size_t) width_ * 4;
+        std::vector<uint8_t> raw;
+        raw.reserve((stride + 1) * height_);
+        for (int y = 0; y < height_; ++y) {
+            raw.push_back(0);
+            raw.insert(raw.end(), rgba.begin() + y * stride, rgba.begin() + (y + 1) * stride);
+        }
+        
+        std::vector<uint8_t> zlib;
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        size_t pos = 0;
+        do {
+            size_t len = std::min((size_t) 65535, raw.size() - pos);
+            zlib.push_back(pos + len == raw.size() ? 1 : 0);
+            zlib.push_back(len & 0xff);
+            zlib.push_back((len >> 8) & 0xff);
+            zlib.push_back(~len & 0xff);
+            zlib.push_back((~len >> 8) & 0xff);
+            zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+            pos += len;
+        } while (pos < raw.size());
+        putBigEndian(&zlib, adler32(raw));
+        
+        std::vector<uint8_t> header;
+        putBigEndian(&header, width_);
+        putBigEndian(&header, height_);
+        header.push_back(8);    // bit depth
+        header.push_back(6);    // color type RGBA
+        header.push_back(0);    // compression
+        header.push_back(0);    // filter
+        header.push_back(0);    // interlace
+        
+        FILE* file = open(path);
+        if (file == NULL) {
+            return false;
+        }
+        const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        fwrite(signature, 1, 8, file);
+        writeChunk(file, "IHDR", header);
+        writeChunk(file, "IDAT", zlib);
+        writeChunk(file, "IEND", std::vector<uint8_t>());
+        return close(file, path);
+    }
+    
+private:
+    int width_, height_;
+    std::vector<float> pixels_;
+    
+    size_t index(int x, int y) const {
+        return ((size_t) y * width_ + x) * 4;
+    }
+    
+    static FILE* open(const std::string& path) {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == NULL) {
+            printf("Could not open %s for writing\n", path.c_str());
+        }
+        return file;
+    }
+    
+    static bool close(FILE* file, const std::string& path) {
+        bool ok = !ferror(file);
+        ok = (fclose(file) == 0) && ok;
+        if (!ok) {
+            printf("Could not write %s\n", path.c_str());
+        }
+        return ok;
+    }
+    
+    static void putBigEndian(std::vector<uint8_t>* out, uint32_t value) {
+        out->push_back((value >> 24) & 0xff);
+        out->push_back((value >> 16) & 0xff);
+        out->push_back((value >> 8) & 0xff);
+        out->push_back(value & 0xff);
+    }
+    
+    static uint32_t adler32(const std::vector<uint8_t>& data) {
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+    
+    // The table is built on the first call, the initialization of a local
+    // static is thread safe
+    static uint32_t crc32(const std::vector<uint8_t>& data) {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> entries;
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[n] = c;
+            }
+            return entries;
+        }();
+        
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 0; i < data.size(); ++i) {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return crc ^ 0xffffffffu;
+    }
+    
+    static void writeChunk(FILE* file, const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> chunk;
+        putBigEndian(&chunk, (uint32_t) data.size());
+        fwrite(chunk.data(), 1, 4, file);
+        
+        chunk.assign(type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        fwrite(chunk.data(), 1, chunk.size(), file);
+        
+        std::vector<uint8_t> crc;
+        putBigEndian(&crc, crc32(chunk));
+        fwrite(crc.data(), 1, 4, file);
+    }
+};
+
+#endif /* framebuffer_h */
@@ -15,5 +15,6 @@
 #include "point3d.h"
 #include "sphere3d.h"
 #include "polygon3d.h"
+#include "ray3d.h"
 
 #endif /* geometry_h */
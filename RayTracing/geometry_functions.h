@@ -9,6 +9,7 @@
 #ifndef geometry_functions_h
 #define geometry_functions_h
 
+#include <vector>
 #include <SDL2/sdl.h>
 
 #include "geometry_constants.h"
@@ -18,20 +19,20 @@
 #include "polygon3d.h"
 
 namespace Geometry {
-    bool isZero(long double a) {
+    bool isZero(Real a) {
         return std::abs(a) < EPS;
     }
     
-    int sign(long double a) {
+    int sign(Real a) {
         if (isZero(a)) return 0;
         return a > 0 ? 1 : -1;
     }
     
-    long double cos(const Point3D& p1, const Point3D& p2) {
+    Real cos(const Point3D& p1, const Point3D& p2) {
         return (p1 * p2) / p1.len() / p2.len();
     }
     
-    bool areEqual(long double x, long double y) {
+    bool areEqual(Real x, Real y) {
         return sign(x - y) == 0;
     }
     
@@ -39,12 +40,16 @@ namespace Geometry {
         return areEqual(p1.x, p2.x) && areEqual(p1.y, p2.y) && areEqual(p1.z, p2.z);
     }
     
+    // Both predicates are relative to the lengths of the vectors, absolute
+    // products of scene sized vectors drown EPS in float and double rounding
     bool areCollinear(const Point3D& p1, const Point3D& p2) {
-        return isZero((p1 ^ p2).len2());
+        Real scale = p1.len() * p2.len();
+        return isZero(scale) || isZero((p1 ^ p2).len() / scale);
     }
     
     bool areComplanar(const Point3D& p1, const Point3D& p2, const Point3D& p3) {
-        return isZero(p1 * (p2 ^ p3));
+        Real scale = p1.len() * p2.len() * p3.len();
+        return isZero(scale) || isZero(p1 * (p2 ^ p3) / scale);
     }
     
     bool isOnLine(const Point3D& p, const Point3D& A, const Point3D& B) {
@@ -74,7 +79,7 @@ namespace Geometry {
         
         Point3D n1 = (B1 - A1) ^ (B2 - B1);
         Point3D n2 = (A2 - A1) ^ (B2 - B1);
-        long double t = sign(n1 * n2) * sqrt(n1.len2() / n2.len2());
+        Real t = sign(n1 * n2) * std::sqrt(n1.len2() / n2.len2());
         
         *crossPoint = A1 + t * (A2 - A1);
         return true;
@@ -140,10 +145,102 @@ namespace Geometry {
         return crossCnt % 2 != 0;
     }
     
+    // Sutherland-Hodgman step: keeps the part of the polygon on one side of the
+    // plane coordinate[axis] == value, the low side if keepLow is set
+    void clipPolygon(std::vector<Point3D>* points, int axis, Real value, bool keepLow) {
+        std::vector<Point3D> result;
+        
+        for (size_t i = 0; i < points->size(); ++i) {
+            const Point3D& a = (*points)[i];
+            const Point3D& b = (*points)[(i + 1) % points->size()];
+            bool aInside = keepLow ? a[axis] <= value : a[axis] >= value;
+            bool bInside = keepLow ? b[axis] <= value : b[axis] >= value;
+            
+            if (aInside) {
+                result.push_back(a);
+            }
+            if (aInside != bInside) {
+                Point3D cross = a + (b - a) * ((value - a[axis]) / (b[axis] - a[axis]));
+                cross[axis] = value;
+                result.push_back(cross);
+            }
+        }
+        points->swap(result);
+    }
+    
+    // Ray constants of the watertight triangle test: the axes are permuted so
+    // the largest component of the guide becomes z, and the shear s turns the
+    // guide into (0, 0, 1). Rays of a packet may share the axes of one of them.
+    struct RayShear {
+        int kx, ky, kz;
+        Real sx, sy, sz;
+        
+        RayShear(int kx, int ky, int kz, Real sx, Real sy, Real sz) : kx(kx), ky(ky), kz(kz), sx(sx), sy(sy), sz(sz) { }
+        
+        RayShear(const Point3D& guide) {
+            kz = std::abs(guide.x) > std::abs(guide.y) ? (std::abs(guide.x) > std::abs(guide.z) ? 0 : 2) :
+                                                         (std::abs(guide.y) > std::abs(guide.z) ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (guide[kz] < 0) {
+                std::swap(kx, ky);
+            }
+            sx = guide[kx] / guide[kz];
+            sy = guide[ky] / guide[kz];
+            sz = 1 / guide[kz];
+        }
+    };
+    
+    // Edge functions of the watertight ray-triangle test of Woop, Benthin and
+    // Wald. The vertices are moved to the ray start and sheared, the edge
+    // functions are then 2D and evaluated the same way for both triangles of a
+    // shared edge, so a ray through the edge hits at least one of them. U, V
+    // and W belong to the edges bc, ca and ab, false if the ray misses.
+    bool triangleEdges(const Point3D& start, const RayShear& s, const Point3D& a, const Point3D& b, const Point3D& c,
+                       Real* U, Real* V, Real* W) {
+        Point3D A = a - start, B = b - start, C = c - start;
+        Real ax = A[s.kx] - s.sx * A[s.kz], ay = A[s.ky] - s.sy * A[s.kz];
+        Real bx = B[s.kx] - s.sx * B[s.kz], by = B[s.ky] - s.sy * B[s.kz];
+        Real cx = C[s.kx] - s.sx * C[s.kz], cy = C[s.ky] - s.sy * C[s.kz];
+        
+        *U = cx * by - cy * bx;
+        *V = ax * cy - ay * cx;
+        *W = bx * ay - by * ax;
+        
+        // A zero is rounding as often as it's an edge, float builds decide it in double
+        if (sizeof(Real) < sizeof(double) && (*U == 0 || *V == 0 || *W == 0)) {
+            *U = (Real) ((double) cx * by - (double) cy * bx);
+            *V = (Real) ((double) ax * cy - (double) ay * cx);
+            *W = (Real) ((double) bx * ay - (double) by * ax);
+        }
+        
+        if ((*U < 0 || *V < 0 || *W < 0) && (*U > 0 || *V > 0 || *W > 0)) {
+            return false;
+        }
+        return *U + *V + *W != 0;
+    }
+    
+    // The whole watertight test, returns the distance along the guide and the
+    // barycentric weights of b and c
+    bool crossTriangle(const Point3D& start, const RayShear& s, const Point3D& a, const Point3D& b, const Point3D& c,
+                       Real* t, Real* u, Real* v) {
+        Real U, V, W;
+        if (!triangleEdges(start, s, a, b, c, &U, &V, &W)) {
+            return false;
+        }
+        
+        Real det = U + V + W;
+        Real T = (U * (a[s.kz] - start[s.kz]) + V * (b[s.kz] - start[s.kz]) + W * (c[s.kz] - start[s.kz])) * s.sz;
+        *t = T / det;
+        *u = V / det;
+        *v = W / det;
+        return true;
+    }
+    
     SDL_Color makeRGBA(Vec3 color) {
-        return SDL_Color{static_cast<Uint8>(std::min((long double) 1, color[0]) * 255),
-            static_cast<Uint8>(std::min((long double) 1, color[1]) * 255),
-            static_cast<Uint8>(std::min((long double) 1, color[2]) * 255),
+        return SDL_Color{static_cast<Uint8>(std::min((Real) 1, color[0]) * 255),
+            static_cast<Uint8>(std::min((Real) 1, color[1]) * 255),
+            static_cast<Uint8>(std::min((Real) 1, color[2]) * 255),
             255};
     }
     
@@ -9,10 +9,54 @@
 #ifndef kdTree_h
 #define kdTree_h
 
+#include <future>
+#include <limits>
+#include <thread>
+
 #include "objects.h"
 
-const long double C_I = 1;
-const long double C_T = 4;
+const Real C_I = 1;
+const Real C_T = 4;
+
+// Below these sizes a node is binned on one thread and its children are built
+// in place, the thread start costs more than it saves
+const size_t KD_PARALLEL_OBJECTS = 16384;
+const size_t KD_TASK_OBJECTS = 1024;
+
+// Deeper nodes stay leaves. Objects meeting in one point, like the triangles
+// around a vertex of a mesh, would be split down to the float resolution.
+const int KD_MAX_DEPTH = 40;
+
+// Calls job(slice, begin, end) for `slices` contiguous slices of [0, size),
+// slice 0 runs on the calling thread
+template<class Job>
+void parallelSlices(size_t size, int slices, Job job) {
+    std::vector<std::thread> pool;
+    for (int slice = 1; slice < slices; ++slice) {
+        pool.push_back(std::thread(job, slice, size * slice / slices, size * (slice + 1) / slices));
+    }
+    job(0, 0, size / slices);
+    
+    for (size_t i = 0; i < pool.size(); ++i) {
+        pool[i].join();
+    }
+}
+
+// Cost model and limits of the exact SAH builder, see SAHKDBuilder
+struct KDBuildParams {
+    Real costIntersect;     // C_I, cost of one object test
+    Real costTraversal;     // C_T, cost of one inner node step
+    Real emptyBonus;        // scales the cost of splits that cut off empty space
+    int maxDepth;
+    int leafSize;           // nodes with this many objects or less are never split
+    
+    KDBuildParams() : costIntersect(C_I), costTraversal(C_T), emptyBonus(0.8), maxDepth(KD_MAX_DEPTH), leafSize(1) { }
+};
+
+enum KDBuilder {
+    KD_BUILDER_BINNED,      // KDNode::build, 32 bins per axis
+    KD_BUILDER_EXACT        // SAHKDBuilder, sorted split events
+};
 
 class KDNode {
 public:
@@ -24,31 +68,56 @@ public:
         delete right_;
     }
     
-    void build() {
+    // Splits the node recursively. With several threads the top levels bin and
+    // partition their objects in parallel slices and the subtrees below are
+    // built as separate tasks, the tree doesn't depend on the number of threads.
+    void build(int threads = 1, int depth = 0) {
         int cnt = 32;
         
-        if (objects_.size() < 2) return;
-
-        long double minSah = C_I * objects_.size();
-
+        if (objects_.size() < 2 || depth >= KD_MAX_DEPTH) return;
+        
+        int slices = objects_.size() >= KD_PARALLEL_OBJECTS ? std::max(1, threads) : 1;
+        
+        // Boxes are fetched once per node, not once per axis and side
+        std::vector<BoundingBox> bBoxes(objects_.size(), bBox_);
+        parallelSlices(objects_.size(), slices, [&](int /*slice*/, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                bBoxes[i] = objects_[i]->boundingBox();
+            }
+        });
+        
+        Real minSah = C_I * objects_.size();
+        
         int minAxis = -1;
-        long double minProp = 0.0;
+        Real minProp = 0.0;
         
         for (int axis = 0; axis < 3; ++axis) {
-            std::vector<int> low(cnt, 0), high(cnt, 0);
+            // Every slice fills its own bins, the counts are summed afterwards
+            std::vector<std::vector<int> > sliceLow(slices, std::vector<int>(cnt, 0));
+            std::vector<std::vector<int> > sliceHigh(slices, std::vector<int>(cnt, 0));
             
-            for (auto obj : objects_) {
-                int ind;
-                
-                ind = (int)((obj->boundingBox().low(axis) - bBox_.low(axis)) / bBox_.length(axis) * cnt);
-                ind = std::min(std::max(0, ind), cnt - 1);
-
-                low[ind]++;
-                
-                ind = (int)((obj->boundingBox().high(axis) - bBox_.low(axis)) / (bBox_.length(axis)) * cnt);
-                ind = std::min(std::max(0, ind), cnt - 1);
-                
-                high[ind]++;
+            parallelSlices(objects_.size(), slices, [&](int slice, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    int ind;
+                    
+                    ind = (int)((bBoxes[i].low(axis) - bBox_.low(axis)) / bBox_.length(axis) * cnt);
+                    ind = std::min(std::max(0, ind), cnt - 1);
+                    
+                    sliceLow[slice][ind]++;
+                    
+                    ind = (int)((bBoxes[i].high(axis) - bBox_.low(axis)) / (bBox_.length(axis)) * cnt);
+                    ind = std::min(std::max(0, ind), cnt - 1);
+                    
+                    sliceHigh[slice][ind]++;
+                }
+            });
+            
+            std::vector<int> low(cnt, 0), high(cnt, 0);
+            for (int slice = 0; slice < slices; ++slice) {
+                for (int i = 0; i < cnt; ++i) {
+                    low[i] += sliceLow[slice][i];
+                    high[i] += sliceHigh[slice][i];
+                }
             }
             
             // find suffix for low and prefics for high
@@ -58,19 +127,20 @@ public:
             }
             
             // find minimum of SAH
-            long double stepLength = bBox_.length(axis) / cnt;
-            long double sStep = (stepLength * bBox_.length((axis + 1) % 3) +
-                                 stepLength * bBox_.length((axis + 2) % 3));
-            long double sBase = bBox_.length((axis + 1) % 3) * bBox_.length((axis + 2) % 3);
+            Real stepLength = bBox_.length(axis) / cnt;
+            Real sStep = (stepLength * bBox_.length((axis + 1) % 3) +
+                          stepLength * bBox_.length((axis + 2) % 3));
+            Real sBase = bBox_.length((axis + 1) % 3) * bBox_.length((axis + 2) % 3);
             
-            long double sParent = sBase + cnt * sStep;
-            long double sLeft  = sBase + sStep;
-            long double sRight = sParent - sStep;
+            Real sParent = sBase + cnt * sStep;
+            Real sLeft  = sBase + sStep;
+            Real sRight = sParent - sStep;
             
-            for (int i = 0; sLeft < sParent; sLeft += sStep, sRight -= sStep, i++) {
+            // cnt - 1 inner bin borders, counting them is safer than comparing the accumulated areas
+            for (int i = 0; i < cnt - 1; sLeft += sStep, sRight -= sStep, i++) {
                 int cntLeft = (int) objects_.size() - low[i + 1];
                 int cntRight = (int) objects_.size() - high[i];
-                long double sah = C_T + C_I * (sLeft * cntLeft + sRight * cntRight) / sParent;
+                Real sah = C_T + C_I * (sLeft * cntLeft + sRight * cntRight) / sParent;
 
                 if (sah < minSah) {
                     minSah = sah;
@@ -81,44 +151,64 @@ public:
         }
         
         if (minAxis >= 0) {
-            std::pair<BoundingBox, BoundingBox> bBoxes = bBox_.split(minAxis, minProp);
-            std::vector<Object3D*> rightObjects, leftObjects;
-            long double splitCoord = bBoxes.first.high(minAxis);
+            // LinearKDTree keeps splits as float, so split on a float value right away
+            float splitCoord = (float) (bBox_.low(minAxis) + bBox_.length(minAxis) * minProp);
+            if (splitCoord < bBox_.low(minAxis)) {
+                splitCoord = std::nextafter(splitCoord, std::numeric_limits<float>::infinity());
+            }
+            if (splitCoord > bBox_.high(minAxis)) {
+                splitCoord = std::nextafter(splitCoord, -std::numeric_limits<float>::infinity());
+            }
+            if (splitCoord < bBox_.low(minAxis) || splitCoord > bBox_.high(minAxis)) {
+                return;     // the box is thinner than a float step
+            }
             
-            for (int i = 0; i < objects_.size(); ++i) {
-                if ((objects_[i]->boundingBox().low(minAxis) < splitCoord + EPS)) {
-                    leftObjects.push_back(objects_[i]);
-                }
-                if ((objects_[i]->boundingBox().high(minAxis) > splitCoord - EPS)) {
-                    rightObjects.push_back(objects_[i]);
+            std::pair<BoundingBox, BoundingBox> childBoxes = bBox_.splitAt(minAxis, splitCoord);
+            
+            // Slices are partitioned apart and joined in order
+            std::vector<std::vector<Object3D*> > sliceLeft(slices), sliceRight(slices);
+            parallelSlices(objects_.size(), slices, [&](int slice, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    if ((bBoxes[i].low(minAxis) < splitCoord + EPS)) {
+                        sliceLeft[slice].push_back(objects_[i]);
+                    }
+                    if ((bBoxes[i].high(minAxis) > splitCoord - EPS)) {
+                        sliceRight[slice].push_back(objects_[i]);
+                    }
                 }
+            });
+            
+            std::vector<Object3D*> rightObjects, leftObjects;
+            for (int slice = 0; slice < slices; ++slice) {
+                leftObjects.insert(leftObjects.end(), sliceLeft[slice].begin(), sliceLeft[slice].end());
+                rightObjects.insert(rightObjects.end(), sliceRight[slice].begin(), sliceRight[slice].end());
             }
             
             objects_.clear();
-                        
-            left_ = new KDNode(bBoxes.first, leftObjects);
-            right_ = new KDNode(bBoxes.second, rightObjects);
+            bBoxes.clear();
+            
+            left_ = new KDNode(childBoxes.first, leftObjects);
+            right_ = new KDNode(childBoxes.second, rightObjects);
             
             splitAxis_ = minAxis;
             
-            left_->build();
-            right_->build();
+            buildChildren(threads, depth + 1);
         }
     }
     
-    bool intersect(Point3D start, Point3D finish, Point3D* crossPoint1, Point3D* crossPoint2) {
+    bool intersect(Point3D start, Point3D finish, Point3D* crossPoint1, Point3D* crossPoint2) const {
         return bBox_.intersect(start, finish, crossPoint1, crossPoint2);
     }
     
-    bool isLeaf() {
+    bool isLeaf() const {
         return splitAxis_ == -1;
     }
     
-    int getSplitAxis() {
+    int getSplitAxis() const {
         return splitAxis_;
     }
     
-    long double getSplitCoord() {
+    Real getSplitCoord() const {
         if (right_ != NULL) {
             return right_->bBox_.low(splitAxis_);
         } else {
@@ -126,7 +216,7 @@ public:
         }
     }
     
-    bool contains(const Point3D& p) {
+    bool contains(const Point3D& p) const {
         return bBox_.contains(p);
     }
 
@@ -135,6 +225,23 @@ public:
     KDNode *left_, *right_;
     
     std::vector<Object3D*> objects_;
+    
+private:
+    // The right subtree becomes a separate task if there are threads left to
+    // share and it is big enough to be worth one
+    void buildChildren(int threads, int depth) {
+        if (threads > 1 && right_->objects_.size() >= KD_TASK_OBJECTS) {
+            KDNode* right = right_;
+            std::future<void> task = std::async(std::launch::async, [right, threads, depth]() {
+                right->build(threads - threads / 2, depth);
+            });
+            left_->build(threads / 2, depth);
+            task.get();
+        } else {
+            left_->build(threads, depth);
+            right_->build(threads, depth);
+        }
+    }
 };
 
 #endif /* kdTree_h */
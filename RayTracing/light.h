@@ -11,32 +11,52 @@
 
 #include "light_params.h"
 #include "object3d.h"
+#include "shading_batch.h"
 
 class Light {
 public:
     Light(Geometry::Point3D position, LightParams params) : lightParams_(params), position_(position) { }
     
-    Geometry::Vec3 intencityAt(const Geometry::Point3D& point, const Object3D& object, const Geometry::Point3D& origin) {
-        Material material = object.material();
+    // Adds the Phong light of the source to the colors of the visible hits.
+    // Each hit gets (La * ambient + Ld * diffuse * (l * n) + Ls * specular *
+    // (r * v)^shine) / (k0 + k1 * d + k2 * d^2), r * v is expanded to
+    // 2 (n * l)(n * v) - l * v so the reflected vector is never built.
+    void illuminate(ShadingBatch* batch, const bool* visible) const {
+        Geometry::Vec3 la = lightParams_.ambient(), ld = lightParams_.diffuse(), ls = lightParams_.specular();
+        Geometry::Vec3 k = lightParams_.distance();
         
-        Geometry::Point3D n = object.normalAt(point).normalize();
-        Geometry::Point3D v = (origin - point).normalize();
-        Geometry::Point3D l = (position_ - point).normalize();
-        Geometry::Point3D r = 2 * (n * l) * n - l;
-        long double cos_r_v = std::max((long double) 0, r * v);
-        
-        Geometry::Vec3 intensity = lightParams_.intensity(material.ambient(),
-                                                          material.diffuse() * (l * n),
-                                                          material.specular() * std::pow(cos_r_v, material.shine()),
-                                                          (position_ - point).len2());
-        
-        return intensity;
+        for (int i = 0; i < batch->count; ++i) {
+            Geometry::Real lx = position_.x - batch->point[0][i];
+            Geometry::Real ly = position_.y - batch->point[1][i];
+            Geometry::Real lz = position_.z - batch->point[2][i];
+            Geometry::Real d2 = lx * lx + ly * ly + lz * lz;
+            Geometry::Real d = std::sqrt(d2);
+            lx /= d;
+            ly /= d;
+            lz /= d;
+            
+            Geometry::Real nl = batch->normal[0][i] * lx + batch->normal[1][i] * ly + batch->normal[2][i] * lz;
+            Geometry::Real nv = batch->normal[0][i] * batch->view[0][i] + batch->normal[1][i] * batch->view[1][i] +
+                                batch->normal[2][i] * batch->view[2][i];
+            Geometry::Real lv = lx * batch->view[0][i] + ly * batch->view[1][i] + lz * batch->view[2][i];
+            Geometry::Real rv = std::max((Geometry::Real) 0, 2 * nl * nv - lv);
+            Geometry::Real specular = batch->shine[i] == 1 ? rv : std::pow(rv, batch->shine[i]);
+            Geometry::Real scale = visible[i] ? 1 / (k.vec[0] + k.vec[1] * d + k.vec[2] * d2) : 0;
+            
+            for (int c = 0; c < 3; ++c) {
+                batch->color[c][i] += (la.vec[c] * batch->ambient[c][i] + ld.vec[c] * batch->diffuse[c][i] * nl +
+                                       ls.vec[c] * batch->specular[c][i] * specular) * scale;
+            }
+        }
     }
-
     
-    Geometry::Point3D position() {
+    Geometry::Point3D position() const {
         return position_;
     }
+    
+    const LightParams& params() const {
+        return lightParams_;
+    }
 private:
     Geometry::Point3D position_;
     LightParams lightParams_;
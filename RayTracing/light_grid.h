@@ -0,0 +1,201 @@
+//
+//  light_grid.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef light_grid_h
+#define light_grid_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "light.h"
+#include "shading_batch.h"
+
+// Below half a step of an 8 bit channel a light is left out
+const Geometry::Real LIGHT_CUTOFF = 1.0 / 512;
+
+// Uniform grid over the spheres of influence of the lights, a sphere reaches
+// as far as LightParams::cutoffDistance(). Every cell lists the lights whose
+// sphere overlaps it. Lights that never fade, or whose sphere would cover too
+// many cells, reach every point and skip the grid.
+class LightGrid {
+public:
+    static const int MAX_CELLS_PER_LIGHT = 512;
+    
+    LightGrid() : cellSize_(1) {
+        dims_[0] = dims_[1] = dims_[2] = 0;
+    }
+    
+    void build(const std::vector<Light*>& lights, Geometry::Real cutoff) {
+        radius2_.resize(lights.size());
+        everywhere_.clear();
+        cellStart_.clear();
+        cellLights_.clear();
+        dims_[0] = dims_[1] = dims_[2] = 0;
+        
+        std::vector<uint32_t> bounded;
+        std::vector<Geometry::Real> radii;
+        for (uint32_t i = 0; i < lights.size(); ++i) {
+            Geometry::Real radius = lights[i]->params().cutoffDistance(cutoff);
+            radius2_[i] = radius * radius;
+            if (std::isinf(radius)) {
+                everywhere_.push_back(i);
+            } else if (radius > 0) {
+                bounded.push_back(i);
+                radii.push_back(radius);
+            }
+        }
+        if (bounded.empty()) {
+            return;
+        }
+        
+        // Cells of about the median radius, a light then overlaps a few of them
+        std::vector<Geometry::Real> sorted(radii);
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        cellSize_ = sorted[sorted.size() / 2];
+        
+        low_ = high_ = lights[bounded[0]]->position();
+        for (size_t k = 0; k < bounded.size(); ++k) {
+            Geometry::Point3D p = lights[bounded[k]]->position();
+            for (int axis = 0; axis < 3; ++axis) {
+                low_[axis] = std::min(low_[axis], p[axis] - radii[k]);
+                high_[axis] = std::max(high_[axis], p[axis] + radii[k]);
+            }
+        }
+        
+        // Bounds that overflow leave nothing to grid
+        for (int axis = 0; axis < 3; ++axis) {
+            if (!std::isfinite(high_[axis] - low_[axis])) {
+                everywhere_.insert(everywhere_.end(), bounded.begin(), bounded.end());
+                std::sort(everywhere_.begin(), everywhere_.end());
+                return;
+            }
+        }
+        
+        // At most a few cells per light, the grid grows its cells until it fits.
+        // The counts only become ints then, before they may be out of range.
+        double maxCells = std::max(64.0, 8.0 * bounded.size());
+        Geometry::Real counts[3];
+        while (true) {
+            Geometry::Real cells = 1;
+            for (int axis = 0; axis < 3; ++axis) {
+                counts[axis] = std::max((Geometry::Real) 1, std::ceil((high_[axis] - low_[axis]) / cellSize_));
+                cells *= counts[axis];
+            }
+            if (cells <= maxCells) {
+                break;
+            }
+            cellSize_ *= 1.25;
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            dims_[axis] = (int) counts[axis];
+        }
+        
+        // Counting pass, then the lists are filled at their offsets
+        cellStart_.assign(dims_[0] * dims_[1] * dims_[2] + 1, 0);
+        std::vector<uint32_t> spread;
+        for (size_t k = 0; k < bounded.size(); ++k) {
+            int from[3], to[3];
+            cellRange(lights[bounded[k]]->position(), radii[k], from, to);
+            if ((to[0] - from[0] + 1) * (to[1] - from[1] + 1) * (to[2] - from[2] + 1) > MAX_CELLS_PER_LIGHT) {
+                everywhere_.push_back(bounded[k]);
+                continue;
+            }
+            spread.push_back((uint32_t) k);
+            forCells(from, to, [this](int cell) {
+                ++cellStart_[cell + 1];
+            });
+        }
+        for (size_t cell = 1; cell < cellStart_.size(); ++cell) {
+            cellStart_[cell] += cellStart_[cell - 1];
+        }
+        
+        cellLights_.resize(cellStart_.back());
+        std::vector<uint32_t> filled(cellStart_.begin(), cellStart_.end() - 1);
+        for (uint32_t k : spread) {
+            int from[3], to[3];
+            uint32_t light = bounded[k];
+            cellRange(lights[light]->position(), radii[k], from, to);
+            forCells(from, to, [this, &filled, light](int cell) {
+                cellLights_[filled[cell]++] = light;
+            });
+        }
+        std::sort(everywhere_.begin(), everywhere_.end());
+    }
+    
+    // Appends the lights that may reach any hit of the batch, sorted and without repeats
+    void query(const ShadingBatch& batch, std::vector<uint32_t>* lights) const {
+        size_t first = lights->size();
+        lights->insert(lights->end(), everywhere_.begin(), everywhere_.end());
+        
+        // Neighbouring hits mostly share their cell, every cell is listed once
+        int cells[ShadingBatch::CAPACITY];
+        int cellCount = 0;
+        for (int i = 0; i < batch.count && dims_[0] > 0; ++i) {
+            int cell = cellOf(batch.hitPoint(i));
+            if (cell >= 0 && std::find(cells, cells + cellCount, cell) == cells + cellCount) {
+                cells[cellCount++] = cell;
+            }
+        }
+        for (int i = 0; i < cellCount; ++i) {
+            lights->insert(lights->end(), cellLights_.begin() + cellStart_[cells[i]],
+                           cellLights_.begin() + cellStart_[cells[i] + 1]);
+        }
+        
+        std::sort(lights->begin() + first, lights->end());
+        lights->erase(std::unique(lights->begin() + first, lights->end()), lights->end());
+    }
+    
+    // The light adds to the point only within this squared distance
+    Geometry::Real reach2(uint32_t light) const {
+        return radius2_[light];
+    }
+    
+private:
+    std::vector<Geometry::Real> radius2_;
+    std::vector<uint32_t> everywhere_;
+    Geometry::Point3D low_, high_;
+    Geometry::Real cellSize_;
+    int dims_[3];
+    std::vector<uint32_t> cellStart_;       // offsets of the cell lists in cellLights_
+    std::vector<uint32_t> cellLights_;
+    
+    // -1 outside of the grid, no bounded light reaches there
+    int cellOf(const Geometry::Point3D& point) const {
+        int index[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            Geometry::Real offset = (point[axis] - low_[axis]) / cellSize_;
+            if (!(offset >= 0) || offset >= dims_[axis]) {
+                return -1;
+            }
+            index[axis] = (int) offset;
+        }
+        return (index[2] * dims_[1] + index[1]) * dims_[0] + index[0];
+    }
+    
+    void cellRange(const Geometry::Point3D& center, Geometry::Real radius, int* from, int* to) const {
+        for (int axis = 0; axis < 3; ++axis) {
+            from[axis] = std::max(0, (int) ((center[axis] - radius - low_[axis]) / cellSize_));
+            to[axis] = std::min(dims_[axis] - 1, (int) ((center[axis] + radius - low_[axis]) / cellSize_));
+        }
+    }
+    
+    template <class Visit>
+    void forCells(const int* from, const int* to, Visit visit) const {
+        for (int z = from[2]; z <= to[2]; ++z) {
+            for (int y = from[1]; y <= to[1]; ++y) {
+                for (int x = from[0]; x <= to[0]; ++x) {
+                    visit((z * dims_[1] + y) * dims_[0] + x);
+                }
+            }
+        }
+    }
+};
+
+#endif /* light_grid_h */
@@ -9,15 +9,17 @@
 #ifndef light_params_h
 #define light_params_h
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include "vec3.h"
 
 class LightParams {
 public:
-    LightParams(long double ambient,
-                long double diffuse,
-                long double specular,
+    LightParams(Geometry::Real ambient,
+                Geometry::Real diffuse,
+                Geometry::Real specular,
                 Geometry::Vec3 kDistance = Geometry::Vec3(0, 0, 1))
     : ambient_(ambient)
     , diffuse_(diffuse)
@@ -33,15 +35,55 @@ public:
     , specular_(specular)
     , distance_(distance) { }
     
+    Geometry::Vec3 ambient() const {
+        return ambient_;
+    }
+    
+    Geometry::Vec3 diffuse() const {
+        return diffuse_;
+    }
+    
+    Geometry::Vec3 specular() const {
+        return specular_;
+    }
+    
+    Geometry::Vec3 distance() const {
+        return distance_;
+    }
+    
+    // Distance beyond which the light adds less than threshold to any channel
+    // of a surface whose material coefficients are at most 1, infinite if the
+    // light doesn't fade or the threshold isn't positive
+    Geometry::Real cutoffDistance(Geometry::Real threshold) const {
+        Geometry::Real peak = 0;
+        for (int c = 0; c < 3; ++c) {
+            peak = std::max(peak, std::abs(ambient_.vec[c]) + std::abs(diffuse_.vec[c]) + std::abs(specular_.vec[c]));
+        }
+        
+        // Solve k0 + k1 d + k2 d^2 = peak / threshold
+        Geometry::Real k0 = distance_.vec[0], k1 = distance_.vec[1], k2 = distance_.vec[2];
+        if (threshold <= 0 || (k1 <= 0 && k2 <= 0)) {
+            return std::numeric_limits<Geometry::Real>::infinity();
+        }
+        Geometry::Real c = k0 - peak / threshold;
+        if (c >= 0) {
+            return 0;
+        }
+        if (k2 <= 0) {
+            return -c / k1;
+        }
+        return (-k1 + std::sqrt(k1 * k1 - 4 * k2 * c)) / (2 * k2);
+    }
+    
     Geometry::Vec3 intensity(Geometry::Vec3 ambient,
                    Geometry::Vec3 diffuse,
                    Geometry::Vec3 specular,
-                   long double d2) const {
-        
+                   Geometry::Real d2) const {
+                   
         return (ambient_  * ambient +
                 diffuse_  * diffuse +
                 specular_ * specular) / (distance_[0] +
-                                         distance_[1] * sqrt(d2) +
+                                         distance_[1] * std::sqrt(d2) +
                                          distance_[2] * d2);
     }
     
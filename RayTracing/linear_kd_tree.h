@@ -0,0 +1,422 @@
+//
+//  linear_kd_tree.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef linear_kd_tree_h
+#define linear_kd_tree_h
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "accelerator.h"
+#include "kdTree.h"
+#include "sah_kd_builder.h"
+#include "mailbox.h"
+#include "ray_packet.h"
+#include "traversal_stack.h"
+
+// 8 byte node of the flattened tree. The low two bits of flags hold the split
+// axis, or 3 for a leaf, the other 30 bits hold the index of the right child
+// for an inner node and the number of objects for a leaf. The left child of
+// an inner node always follows it in the array.
+struct LinearKDNode {
+    union {
+        float split;                // inner node: split coordinate
+        uint32_t firstObject;       // leaf: offset into the shared object index array
+    };
+    uint32_t flags;
+    
+    static const uint32_t LEAF = 3;
+    
+    bool isLeaf() const {
+        return (flags & 3) == LEAF;
+    }
+    
+    int axis() const {
+        return flags & 3;
+    }
+    
+    uint32_t rightChild() const {
+        return flags >> 2;
+    }
+    
+    uint32_t objectCount() const {
+        return flags >> 2;
+    }
+};
+
+static_assert(sizeof(LinearKDNode) == 8, "LinearKDNode has to stay 8 bytes");
+static_assert(KD_MAX_DEPTH <= TRAVERSAL_DEPTH, "KD-trees have to fit the traversal stack");
+
+// Pointer free copy of a built KDNode tree: the nodes live in one array in
+// depth first order and all leaves share one array of object indices.
+class LinearKDTree : public Accelerator {
+public:
+    LinearKDTree(KDBuilder builder = KD_BUILDER_BINNED, const KDBuildParams& params = KDBuildParams()) :
+        bBox_(Point3D(0, 0, 0), Point3D(0, 0, 0)), sourceBytes_(0), builder_(builder), params_(params) {
+        // A walk keeps at most one far half per level on its stack
+        params_.maxDepth = std::min(params_.maxDepth, TRAVERSAL_DEPTH);
+    }
+    
+    // Builds a KDNode tree with the chosen builder and flattens it
+    virtual void build(const std::vector<Object3D*>& objects, int threads) {
+        if (objects.empty()) {
+            nodes_.clear();
+            indices_.clear();
+            objects_.clear();
+            sourceBytes_ = 0;
+            return;
+        }
+        
+        KDNode* root;
+        if (builder_ == KD_BUILDER_EXACT) {
+            root = SAHKDBuilder(params_).build(objects, threads);
+        } else {
+            root = new KDNode(objects);
+            root->build(threads);
+        }
+        build(root, objects);
+        delete root;
+    }
+    
+    void build(const KDNode* root, const std::vector<Object3D*>& objects) {
+        nodes_.clear();
+        indices_.clear();
+        objects_ = objects;
+        bBox_ = root->bBox_;
+        sourceBytes_ = 0;
+        
+        std::unordered_map<const Object3D*, uint32_t> ids;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            ids[objects[i]] = (uint32_t) i;
+        }
+        flatten(root, ids);
+    }
+    
+    bool empty() const {
+        return nodes_.empty();
+    }
+    
+    // Closest hit of the ray, the leaves are visited front to back. The walk
+    // ends at the leaf the closest hit so far lies in, and the far halves
+    // left on the stack are clipped to it. An object met again in a later
+    // leaf is skipped: the ray has only shrunk since, so the test would miss
+    // or find the hit it already holds.
+    virtual bool intersect(Ray* ray, Object3D** crossObject) const
+    {
+        *crossObject = NULL;
+        
+        Real tNear, tFar;
+        if (empty() || !bBox_.clip(*ray, &tNear, &tFar)) {
+            return false;
+        }
+        
+        struct Entry {
+            uint32_t node;
+            Real tNear, tFar;
+        };
+        TraversalStack<Entry, TRAVERSAL_DEPTH> stack;
+        Mailbox mailbox;
+        bool shared = indices_.size() > objects_.size();    // else every object is in one leaf
+        
+        uint32_t node = 0;
+        while (true) {
+            const LinearKDNode& current = nodes_[node];
+            
+            if (current.isLeaf()) {
+                for (uint32_t i = 0; i < current.objectCount(); ++i) {
+                    uint32_t id = indices_[current.firstObject + i];
+                    if (!(shared && mailbox.visited(id)) && objects_[id]->intersect(ray)) {
+                        *crossObject = objects_[id];
+                    }
+                }
+                
+                // A hit beyond the leaf may still lose to one in the leaves behind it
+                if (ray->tMax <= tFar + EPS || stack.empty()) {
+                    break;
+                }
+                
+                // The stack holds the nearest half on top
+                Entry entry = stack.pop();
+                node = entry.node;
+                tNear = entry.tNear;
+                tFar = std::min(entry.tFar, ray->tMax);
+                if (tNear > tFar) {
+                    break;
+                }
+            } else {
+                int axis = current.axis();
+                Real tSplit = (current.split - ray->origin[axis]) * ray->inv[axis];
+                
+                bool leftFirst = ray->origin[axis] < current.split ||
+                                 (ray->origin[axis] == current.split && ray->direction[axis] <= 0);
+                uint32_t nearNode = leftFirst ? node + 1 : current.rightChild();
+                uint32_t farNode  = leftFirst ? current.rightChild() : node + 1;
+                
+                if (tSplit > tFar || tSplit <= 0) {
+                    node = nearNode;
+                } else if (tSplit < tNear) {
+                    node = farNode;
+                } else {
+                    Entry entry = {farNode, tSplit, tFar};
+                    stack.push(entry);
+                    node = nearNode;
+                    tFar = tSplit;
+                }
+            }
+        }
+        
+        return *crossObject != NULL;
+    }
+    
+    // Any hit on the ray, the leaves are visited front to back as in intersect().
+    // An object that missed in one leaf misses the whole ray, it isn't tested again.
+    virtual bool occluded(const Ray& ray) const {
+        Real tNear, tFar;
+        if (empty() || !bBox_.clip(ray, &tNear, &tFar)) {
+            return false;
+        }
+        
+        struct Entry {
+            uint32_t node;
+            Real tNear, tFar;
+        };
+        TraversalStack<Entry, TRAVERSAL_DEPTH> stack;
+        Mailbox mailbox;
+        bool shared = indices_.size() > objects_.size();
+        
+        uint32_t node = 0;
+        while (true) {
+            const LinearKDNode& current = nodes_[node];
+            
+            if (current.isLeaf()) {
+                for (uint32_t i = 0; i < current.objectCount(); ++i) {
+                    uint32_t id = indices_[current.firstObject + i];
+                    if (!(shared && mailbox.visited(id)) && objects_[id]->occludes(ray)) {
+                        return true;
+                    }
+                }
+                
+                if (stack.empty()) {
+                    return false;
+                }
+                Entry entry = stack.pop();
+                node = entry.node;
+                tNear = entry.tNear;
+                tFar = entry.tFar;
+            } else {
+                int axis = current.axis();
+                Real tSplit = (current.split - ray.origin[axis]) * ray.inv[axis];
+                
+                bool leftFirst = ray.origin[axis] < current.split ||
+                                 (ray.origin[axis] == current.split && ray.direction[axis] <= 0);
+                uint32_t nearNode = leftFirst ? node + 1 : current.rightChild();
+                uint32_t farNode  = leftFirst ? current.rightChild() : node + 1;
+                
+                if (tSplit > tFar || tSplit <= 0) {
+                    node = nearNode;
+                } else if (tSplit < tNear) {
+                    node = farNode;
+                } else {
+                    Entry entry = {farNode, tSplit, tFar};
+                    stack.push(entry);
+                    node = nearNode;
+                    tFar = tSplit;
+                }
+            }
+        }
+    }
+    
+    // Closest hits of a coherent packet, see RayTracer::tracePacket
+    virtual void intersect(RayPacket* packet) const {
+        const int SIZE = RayPacket::SIZE;
+        if (empty()) {
+            return;
+        }
+        
+        struct Entry {
+            uint32_t node;
+            Real tNear[SIZE], tFar[SIZE];
+        };
+        
+        Entry current;
+        current.node = 0;
+        bBox_.intersect(*packet, current.tNear, current.tFar);
+        
+        bool done[SIZE], active[SIZE];
+        for (int i = 0; i < SIZE; ++i) {
+            done[i] = i >= packet->count || current.tNear[i] > current.tFar[i];
+        }
+        
+        TraversalStack<Entry, TRAVERSAL_DEPTH> stack;
+        while (true) {
+            bool any = false;
+            for (int i = 0; i < SIZE; ++i) {
+                active[i] = !done[i] && current.tNear[i] <= current.tFar[i];
+                any = any || active[i];
+            }
+            
+            const LinearKDNode& node = nodes_[current.node];
+            if (any && node.isLeaf()) {
+                for (uint32_t k = 0; k < node.objectCount(); ++k) {
+                    objects_[indices_[node.firstObject + k]]->intersectPacket(packet, current.tNear, current.tFar, active);
+                }
+                // A hit inside the leaf can't be beaten by the leaves behind it
+                for (int i = 0; i < SIZE; ++i) {
+                    done[i] = done[i] || (active[i] && packet->t[i] <= current.tFar[i] + EPS);
+                }
+            } else if (any) {
+                int axis = node.axis();
+                bool positive = packet->d[axis][0] > 0;
+                uint32_t nearNode = positive ? current.node + 1 : node.rightChild();
+                uint32_t farNode  = positive ? node.rightChild() : current.node + 1;
+                
+                Real tSplit[SIZE];
+                bool needNear = false, needFar = false;
+                for (int i = 0; i < SIZE; ++i) {
+                    tSplit[i] = (node.split - packet->o[axis][i]) * packet->inv[axis][i];
+                    needNear = needNear || (active[i] && current.tNear[i] <= tSplit[i]);
+                    needFar  = needFar  || (active[i] && current.tFar[i]  >= tSplit[i]);
+                }
+                
+                if (needNear && needFar) {
+                    Entry farEntry;
+                    farEntry.node = farNode;
+                    for (int i = 0; i < SIZE; ++i) {
+                        farEntry.tNear[i] = std::max(current.tNear[i], tSplit[i]);
+                        farEntry.tFar[i] = current.tFar[i];
+                        current.tFar[i] = std::min(current.tFar[i], tSplit[i]);
+                    }
+                    stack.push(farEntry);
+                }
+                current.node = needNear ? nearNode : farNode;
+                continue;
+            }
+            
+            if (stack.empty()) {
+                break;
+            }
+            current = stack.pop();
+        }
+    }
+    
+    virtual AcceleratorData data() const {
+        AcceleratorData data;
+        data.nodes = nodes_.data();
+        data.nodeBytes = nodes_.size() * sizeof(LinearKDNode);
+        data.indices = indices_.data();
+        data.indexCount = indices_.size();
+        data.bBox = bBox_;
+        return data;
+    }
+    
+    virtual bool load(const AcceleratorData& data, const std::vector<Object3D*>& objects) {
+        if (!loadArrays(data, objects.size(), &nodes_, &indices_) || !validTree()) {
+            nodes_.clear();
+            indices_.clear();
+            return false;
+        }
+        objects_ = objects;
+        bBox_ = data.bBox;
+        sourceBytes_ = 0;
+        return true;
+    }
+    
+    virtual size_t memoryUsage() const {
+        return nodes_.size() * sizeof(LinearKDNode) + indices_.size() * sizeof(uint32_t);
+    }
+    
+    // Node and object list bytes of the tree before and after flattening
+    virtual void printMemoryReport(std::ostream& out) const {
+        size_t leaves = 0;
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            leaves += nodes_[i].isLeaf();
+        }
+        
+        out << "KD-tree: " << nodes_.size() << " nodes, " << leaves << " leaves, "
+            << indices_.size() << " object references" << std::endl;
+        out << "  KDNode tree:   " << sourceBytes_ << " bytes ("
+            << (nodes_.empty() ? 0 : sourceBytes_ / nodes_.size()) << " per node)" << std::endl;
+        out << "  linear layout: " << memoryUsage() << " bytes ("
+            << nodes_.size() * sizeof(LinearKDNode) << " in nodes, "
+            << indices_.size() * sizeof(uint32_t) << " in object indices)" << std::endl;
+    }
+    
+private:
+    std::vector<LinearKDNode> nodes_;
+    std::vector<uint32_t> indices_;
+    std::vector<Object3D*> objects_;
+    BoundingBox bBox_;
+    size_t sourceBytes_;
+    KDBuilder builder_;
+    KDBuildParams params_;
+    
+    // The walks trust the arrays, a loaded copy is checked once: every child
+    // follows its parent, no node is reached twice, inner nodes fit the
+    // traversal stack and every leaf slice lies within indices_
+    bool validTree() const {
+        struct Pending {
+            uint32_t node;
+            int depth;
+        };
+        std::vector<Pending> pending;
+        if (!nodes_.empty()) {
+            Pending root = {0, 0};
+            pending.push_back(root);
+        }
+        size_t visited = 0;
+        while (!pending.empty()) {
+            uint32_t index = pending.back().node;
+            int depth = pending.back().depth;
+            pending.pop_back();
+            if (index >= nodes_.size() || ++visited > nodes_.size()) {
+                return false;
+            }
+            
+            const LinearKDNode& node = nodes_[index];
+            if (node.isLeaf()) {
+                if ((uint64_t) node.firstObject + node.objectCount() > indices_.size()) {
+                    return false;
+                }
+            } else {
+                if (node.rightChild() <= index + 1 || depth >= TRAVERSAL_DEPTH) {
+                    return false;
+                }
+                Pending left = {index + 1, depth + 1}, right = {node.rightChild(), depth + 1};
+                pending.push_back(left);
+                pending.push_back(right);
+            }
+        }
+        return true;
+    }
+    
+    void flatten(const KDNode* node, const std::unordered_map<const Object3D*, uint32_t>& ids) {
+        sourceBytes_ += sizeof(KDNode) + node->objects_.capacity() * sizeof(Object3D*);
+        
+        uint32_t index = (uint32_t) nodes_.size();
+        nodes_.push_back(LinearKDNode());
+        
+        if (node->isLeaf()) {
+            nodes_[index].firstObject = (uint32_t) indices_.size();
+            nodes_[index].flags = ((uint32_t) node->objects_.size() << 2) | LinearKDNode::LEAF;
+            for (size_t i = 0; i < node->objects_.size(); ++i) {
+                indices_.push_back(ids.at(node->objects_[i]));
+            }
+            return;
+        }
+        
+        // build() splits on float coordinates, so the cast is exact
+        nodes_[index].split = (float) node->getSplitCoord();
+        flatten(node->left_, ids);
+        nodes_[index].flags = ((uint32_t) nodes_.size() << 2) | (uint32_t) node->getSplitAxis();
+        flatten(node->right_, ids);
+    }
+};
+
+#endif /* linear_kd_tree_h */
@@ -0,0 +1,49 @@
+//
+//  mailbox.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef mailbox_h
+#define mailbox_h
+
+#include <cstdint>
+
+// Objects one ray has already been tested against. A KD-tree lists an
+// object in every leaf it overlaps, and a ray crossing several of them
+// would test it again in each. The table lives in the frame of the
+// traversal like its stack, so it needs no ray ids and no locking. It is
+// direct mapped: an object evicts the one in its slot, which may then be
+// tested twice. A full table never gives a wrong answer, it only lets
+// some repeats through.
+class Mailbox {
+public:
+    static const int BITS = 4;
+    static const int SIZE = 1 << BITS;
+    
+    Mailbox() {
+        for (int i = 0; i < SIZE; ++i) {
+            ids_[i] = EMPTY;
+        }
+    }
+    
+    // True if the object was tested before, otherwise it is recorded
+    bool visited(uint32_t id) {
+        // Fibonacci hashing, the top bits of the product pick the slot
+        uint32_t& slot = ids_[(uint32_t) (id * 2654435761u) >> (32 - BITS)];
+        if (slot == id) {
+            return true;
+        }
+        slot = id;
+        return false;
+    }
+    
+private:
+    static const uint32_t EMPTY = 0xFFFFFFFF;
+    
+    uint32_t ids_[SIZE];
+};
+
+#endif /* mailbox_h */
@@ -7,20 +7,225 @@
 //
 
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <random>
 #include <SDL2/sdl.h>
 #include <OpenGL/gl3.h>
 #include "ray.h"
 #include "geometry.h"
 #include "objects.h"
+#include "obj_loader.h"
 
 using namespace Geometry;
 
+void buildScene(RayTracer* rayTracer) {
+    rayTracer->createObject<Sphere>(
+                                    Point3D(400, 300, 900),
+                                    200,
+                                    rayTracer->addMaterial(Material(Vec3(0.25, 0.41, 0.93), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1))
+                                    );
+    
+    
+    rayTracer->createObject<Sphere>(
+                                    Point3D(0, 0, 500),
+                                    100,
+                                    rayTracer->addMaterial(Material(Vec3(1, 0.55, 0), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1))
+                                    );
+
+    rayTracer->createObject<Sphere>(
+                                    Point3D(-100, 0, 500),
+                                    100,
+                                    rayTracer->addMaterial(Material(Vec3(0.86, 0.08, 0), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1))
+                                    );
+    
+    rayTracer->createObject<Sphere>(
+                                    Point3D(100, 0, 500),
+                                    100,
+                                    rayTracer->addMaterial(Material(Vec3(1, 0.84, 0), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1))
+                                    );
+    
+    rayTracer->createObject<Sphere>(
+                                    Point3D(-50, 100, 500),
+                                    100,
+                                    rayTracer->addMaterial(Material(Vec3(0.2, 0.8, 0.2), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1))
+                                    );
+    
+    rayTracer->createObject<Sphere>(
+                                    Point3D(50, 100, 500),
+                                    100,
+                                    rayTracer->addMaterial(Material(Vec3(0, 0.75, 1), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1))
+                                    );
+    
+    Point3D wall1[4] = { Point3D(-500, -400, 0), Point3D(-500, -400, 1000), Point3D(-500, 400, 1000), Point3D(-500, 400, 0) };
+    Point3D wall2[4] = { Point3D(500, -400, 0), Point3D(500, -400, 1000), Point3D(500, 400, 1000), Point3D(500, 400, 0) };
+    Point3D wall3[4] = { Point3D(-500, -400, 1000), Point3D(500, -400, 1000), Point3D(500, 400, 1000), Point3D(-500, 400, 1000) };
+    Point3D wall4[4] = { Point3D(-500, -400, 0), Point3D(-500, -400, 1000), Point3D(500, -400, 1000), Point3D(500, -400, 0) };
+    Point3D wall5[4] = { Point3D(-500, 400, 0), Point3D(-500, 400, 1000), Point3D(500, 400, 1000), Point3D(500, 400, 0) };
+    
+    uint32_t sideWalls = rayTracer->addMaterial(Material(Vec3(0.16, 0.73, 0.6), Vec3(0.2, 0.2, 0.2), Vec3(1, 1, 1)));
+    rayTracer->createObject<Quadrangle>(
+                                     wall1,
+                                     sideWalls
+                                     );
+    rayTracer->createObject<Quadrangle>(
+                                     wall2,
+                                     sideWalls
+                                     );
+    rayTracer->createObject<Quadrangle>(
+                                     wall3,
+                                     sideWalls
+                                     );
+    rayTracer->createObject<Quadrangle>(
+                                     wall4,
+                                     rayTracer->addMaterial(Material(Vec3(0.99, 0.99, 0.99), Vec3(0.01, 0.01, 0.01), Vec3(1, 1, 1)))
+                                     );
+    rayTracer->createObject<Quadrangle>(
+                                     wall5,
+                                     rayTracer->addMaterial(Material(Vec3(0.79, 0.41, 0.14), Vec3(0.1, 0.1, 0.1), Vec3(1, 1, 1)))
+                                     );
+    
+    rayTracer->createLight(Point3D(0, -350, 250), LightParams(0, 100000, 1000));
+    rayTracer->createLight(Point3D(0, -350, 600), LightParams(0, 100000, 1000));
+}
+
+// Random triangles filling the room, for profiling the acceleration structures
+void buildTriangleSoup(RayTracer* rayTracer, int count) {
+    std::mt19937 random(17);
+    std::uniform_real_distribution<double> unit(0, 1);
+    Real size = 2 * std::cbrt(800.0 * 600.0 * 700.0 / count);
+    
+    for (int i = 0; i < count; ++i) {
+        Point3D center(-400 + 800 * unit(random), -300 + 600 * unit(random), 200 + 700 * unit(random));
+        Point3D points[3];
+        for (int k = 0; k < 3; ++k) {
+            points[k] = center + Point3D(unit(random) - 0.5, unit(random) - 0.5, unit(random) - 0.5) * size;
+        }
+        Vec3 color(unit(random), unit(random), unit(random));
+        rayTracer->createObject<Triangle>(points, rayTracer->addMaterial(Material(color, Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1))));
+    }
+    
+    rayTracer->createLight(Point3D(0, -350, 250), LightParams(0, 100000, 1000));
+    rayTracer->createLight(Point3D(0, -350, 600), LightParams(0, 100000, 1000));
+}
+
+void printUsage(const char* name) {
+    std::cout << "Usage: " << name << " [options]" << std::endl;
+    std::cout << "  -o, --output FILE  render without a window and save the image (.ppm, .pfm or .png)" << std::endl;
+    std::cout << "  --threads N        number of render threads, all cores by default" << std::endl;
+    std::cout << "  --tile N           tile size in pixels, 16 by default" << std::endl;
+    std::cout << "  --no-packets       trace primary rays one by one instead of in packets" << std::endl;
+    std::cout << "  --scene FILE       load the scene from a .rt file instead of the built-in one" << std::endl;
+    std::cout << "  --cache FILE       with --scene: load the scene and its acceleration structure from FILE," << std::endl;
+    std::cout << "                     or write them there if FILE is missing or stale" << std::endl;
+    std::cout << "  --obj FILE         add the triangles of a Wavefront OBJ file to the scene" << std::endl;
+    std::cout << "  --triangles N      replace the scene with N random triangles" << std::endl;
+    std::cout << "  --accel NAME       acceleration structure, kd (default), bvh or bvh4" << std::endl;
+    std::cout << "  --kd-builder NAME  KD-tree builder, binned (default) or exact" << std::endl;
+    std::cout << "  --accel-report     build the acceleration structure, print its memory use and build time and exit" << std::endl;
+    std::cout << "  --light-cutoff X   leave a light out where it adds less than X to a color, 1/512 by default," << std::endl;
+    std::cout << "                     0 keeps every light everywhere" << std::endl;
+    std::cout << "  --samples N        render progressively until N samples per pixel, 1 by default" << std::endl;
+    std::cout << "  --budget SECONDS   render progressively for at most that long, with no --samples" << std::endl;
+    std::cout << "                     as many samples as fit" << std::endl;
+    std::cout << "  --preview N        a progressive render first shows one ray per N x N pixels, 4 by default," << std::endl;
+    std::cout << "                     1 skips the preview" << std::endl;
+    std::cout << "  --sampler NAME     sub-pixel pattern of the samples: sobol (default), halton, stratified," << std::endl;
+    std::cout << "                     blue or r2" << std::endl;
+    std::cout << "  --adaptive T       once every pixel has the uniform samples, only edges and pixels whose" << std::endl;
+    std::cout << "                     luminance has a standard error above T get more, up to --samples" << std::endl;
+    std::cout << "  --uniform N        samples every pixel gets with --adaptive, 4 by default" << std::endl;
+    std::cout << "  --stats            print the build and trace times and the rays per second of a render" << std::endl;
+}
+
 int main(int argc, const char * argv[]) {
+    std::string output;
+    std::string scene;
+    std::string cache;
+    std::string obj;
+    int threads = TileScheduler::defaultThreads();
+    int tileSize = 16;
+    bool packets = true;
+    int triangles = 0;
+    bool accelReport = false;
+    AcceleratorType accelerator = ACCELERATOR_KD_TREE;
+    KDBuilder kdBuilder = KD_BUILDER_BINNED;
+    Real lightCutoff = LIGHT_CUTOFF;
+    SamplerType sampler = SAMPLER_SOBOL;
+    ProgressiveParams progressive;
+    progressive.samples = 0;        // with --budget alone as many as fit
+    bool stats = false;
     
-    int a = 20;
-    int& b = a;
-    a = 10;
-    std::cout << b;
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            tileSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-packets") == 0) {
+            packets = false;
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            scene = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache = argv[++i];
+        } else if (strcmp(argv[i], "--obj") == 0 && i + 1 < argc) {
+            obj = argv[++i];
+        } else if (strcmp(argv[i], "--triangles") == 0 && i + 1 < argc) {
+            triangles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--accel-report") == 0) {
+            accelReport = true;
+        } else if (strcmp(argv[i], "--accel") == 0 && i + 1 < argc && strcmp(argv[i + 1], "kd") == 0) {
+            accelerator = ACCELERATOR_KD_TREE;
+            ++i;
+        } else if (strcmp(argv[i], "--accel") == 0 && i + 1 < argc && strcmp(argv[i + 1], "bvh") == 0) {
+            accelerator = ACCELERATOR_BVH;
+            ++i;
+        } else if (strcmp(argv[i], "--accel") == 0 && i + 1 < argc && strcmp(argv[i + 1], "bvh4") == 0) {
+            accelerator = ACCELERATOR_BVH4;
+            ++i;
+        } else if (strcmp(argv[i], "--kd-builder") == 0 && i + 1 < argc && strcmp(argv[i + 1], "binned") == 0) {
+            kdBuilder = KD_BUILDER_BINNED;
+            ++i;
+        } else if (strcmp(argv[i], "--kd-builder") == 0 && i + 1 < argc && strcmp(argv[i + 1], "exact") == 0) {
+            kdBuilder = KD_BUILDER_EXACT;
+            ++i;
+        } else if (strcmp(argv[i], "--light-cutoff") == 0 && i + 1 < argc) {
+            lightCutoff = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            progressive.samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            progressive.seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--preview") == 0 && i + 1 < argc) {
+            progressive.previewBlock = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && strcmp(argv[i + 1], "sobol") == 0) {
+            sampler = SAMPLER_SOBOL;
+            ++i;
+        } else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && strcmp(argv[i + 1], "halton") == 0) {
+            sampler = SAMPLER_HALTON;
+            ++i;
+        } else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && strcmp(argv[i + 1], "stratified") == 0) {
+            sampler = SAMPLER_STRATIFIED;
+            ++i;
+        } else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && strcmp(argv[i + 1], "blue") == 0) {
+            sampler = SAMPLER_BLUE_NOISE;
+            ++i;
+        } else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && strcmp(argv[i + 1], "r2") == 0) {
+            sampler = SAMPLER_R2;
+            ++i;
+        } else if (strcmp(argv[i], "--adaptive") == 0 && i + 1 < argc) {
+            progressive.threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--uniform") == 0 && i + 1 < argc) {
+            progressive.uniformSamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
     
     RayTracer rayTracer(
                         Point3D(0, 0, -500),
@@ -30,89 +235,84 @@ int main(int argc, const char * argv[]) {
                                Point3D(-400, 300, 0)
                                )
                         );
+    rayTracer.setThreads(threads);
+    rayTracer.setTileSize(tileSize);
+    rayTracer.setPackets(packets);
+    rayTracer.setAccelerator(accelerator);
+    rayTracer.setKDBuilder(kdBuilder);
+    rayTracer.setLightCutoff(lightCutoff);
+    rayTracer.setSampler(sampler);
     
-    if (!rayTracer.start()) {
-        return EXIT_FAILURE;
+    if (!scene.empty()) {
+        std::ifstream file(scene);
+        if (!file) {
+            printf("Could not open %s\n", scene.c_str());
+            return EXIT_FAILURE;
+        }
+        if (!(cache.empty() ? rayTracer.load(file) : rayTracer.load(file, cache))) {
+            return EXIT_FAILURE;
+        }
+    } else if (triangles > 0) {
+        buildTriangleSoup(&rayTracer, triangles);
+    } else {
+        buildScene(&rayTracer);
     }
     
-    rayTracer.addObject(new Sphere(
-                                   Point3D(400, 300, 900),
-                                   200,
-                                   Material(Vec3(0.25, 0.41, 0.93), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1)
-                                   )
-                        );
-    
-    
-    rayTracer.addObject(new Sphere(
-                                   Point3D(0, 0, 500),
-                                   100,
-                                   Material(Vec3(1, 0.55, 0), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1)
-                                   )
-                        );
-
-    rayTracer.addObject(new Sphere(
-                                   Point3D(-100, 0, 500),
-                                   100,
-                                   Material(Vec3(0.86, 0.08, 0), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1)
-                                   )
-                        );
-    
-    rayTracer.addObject(new Sphere(
-                                   Point3D(100, 0, 500),
-                                   100,
-                                   Material(Vec3(1, 0.84, 0), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1)
-                                   )
-                        );
-    
-    rayTracer.addObject(new Sphere(
-                                   Point3D(-50, 100, 500),
-                                   100,
-                                   Material(Vec3(0.2, 0.8, 0.2), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1)
-                                   )
-                        );
-    
-    rayTracer.addObject(new Sphere(
-                                   Point3D(50, 100, 500),
-                                   100,
-                                   Material(Vec3(0, 0.75, 1), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1), 1)
-                                   )
-                        );
+    if (!obj.empty()) {
+        TriangleMesh* mesh = rayTracer.createMesh();
+        ObjLoader loader(Material(Vec3(0.6, 0.6, 0.6), Vec3(0.5, 0.5, 0.5), Vec3(1, 1, 1)));
+        if (!loader.load(obj, mesh)) {
+            printf("Could not load %s: %s\n", obj.c_str(), loader.error().c_str());
+            return EXIT_FAILURE;
+        }
+        rayTracer.addMesh(mesh);
+    }
     
-    rayTracer.addObject(new Quadrangle(
-                                    (Point3D[4]){ Point3D(-500, -400, 0), Point3D(-500, -400, 1000), Point3D(-500, 400, 1000), Point3D(-500, 400, 0) },
-                                    Material(Vec3(0.16, 0.73, 0.6), Vec3(0.2, 0.2, 0.2), Vec3(1, 1, 1))
-                                    )
-                        );
-    rayTracer.addObject(new Quadrangle(
-                                    (Point3D[4]){ Point3D(500, -400, 0),
-                                                  Point3D(500, -400, 1000),
-                                                  Point3D(500, 400, 1000),
-                                                  Point3D(500, 400, 0) },
-                                    Material(Vec3(0.16, 0.73, 0.6), Vec3(0.2, 0.2, 0.2), Vec3(1, 1, 1))
-                                    )
-                        );
-    rayTracer.addObject(new Quadrangle(
-                                    (Point3D[4]){ Point3D(-500, -400, 1000), Point3D(500, -400, 1000), Point3D(500, 400, 1000), Point3D(-500, 400, 1000) },
-                                    Material(Vec3(0.16, 0.73, 0.6), Vec3(0.2, 0.2, 0.2), Vec3(1, 1, 1))
-                                    )
-                        );
-    rayTracer.addObject(new Quadrangle(
-                                    (Point3D[4]){ Point3D(-500, -400, 0), Point3D(-500, -400, 1000), Point3D(500, -400, 1000), Point3D(500, -400, 0) },
-                                    Material(Vec3(0.99, 0.99, 0.99), Vec3(0.01, 0.01, 0.01), Vec3(1, 1, 1))
-                                    )
-                        );
-    rayTracer.addObject(new Quadrangle(
-                                    (Point3D[4]){ Point3D(-500, 400, 0), Point3D(-500, 400, 1000), Point3D(500, 400, 1000), Point3D(500, 400, 0) },
-                                    Material(Vec3(0.79, 0.41, 0.14), Vec3(0.1, 0.1, 0.1), Vec3(1, 1, 1))
-                                    )
-                        );
+    if (accelReport) {
+        if (!rayTracer.treeBuilt()) {
+            rayTracer.buildTree();
+        }
+        rayTracer.accelerator().printMemoryReport(std::cout);
+        std::cout << "  built in " << rayTracer.buildSeconds() << " s" << std::endl;
+        return EXIT_SUCCESS;
+    }
     
-    rayTracer.addLight(new Light(Point3D(0, -350, 250), LightParams(0, 100000, 1000)));
-    rayTracer.addLight(new Light(Point3D(0, -350, 600), LightParams(0, 100000, 1000)));
+    // Headless mode, SDL is never initialized. A progressive render rewrites
+    // the image after every pass.
+    if (!output.empty() && (progressive.samples > 1 || progressive.seconds > 0)) {
+        bool written = true;
+        auto start = std::chrono::steady_clock::now();
+        rayTracer.renderProgressive(progressive, [&](const Framebuffer& framebuffer, int samples) {
+            written = framebuffer.write(output);
+            if (stats) {
+                std::cout << (samples == 0 ? "preview" : std::to_string(samples) + " spp") << " after "
+                          << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                          << " s" << std::endl;
+            }
+            return written;
+        });
+        if (stats) {
+            std::cout << "build " << rayTracer.buildSeconds() << " s, trace " << rayTracer.renderSeconds() << " s, "
+                      << rayTracer.rays() / rayTracer.renderSeconds() / 1e6 << " Mrays/s" << std::endl;
+        }
+        return written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (!output.empty()) {
+        rayTracer.render();
+        if (stats) {
+            std::cout << "build " << rayTracer.buildSeconds() << " s, trace " << rayTracer.renderSeconds() << " s, "
+                      << rayTracer.rays() / rayTracer.renderSeconds() / 1e6 << " Mrays/s" << std::endl;
+        }
+        return rayTracer.framebuffer().write(output) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     
-    rayTracer.draw();
+    if (!rayTracer.start()) {
+        return EXIT_FAILURE;
+    }
     
-    while(!rayTracer.shouldClose()) {}
+    if (rayTracer.drawProgressive(progressive)) {
+        while(!rayTracer.shouldClose()) {}
+    }
     rayTracer.stop();
     
     return EXIT_SUCCESS;
@@ -16,7 +16,7 @@ public:
     Material(Geometry::Vec3 ambient,
              Geometry::Vec3 diffuse,
              Geometry::Vec3 specular,
-             long double shine = 1,
+             Geometry::Real shine = 1,
              Geometry::Vec3 emit = Geometry::Vec3(0, 0, 0),
              Geometry::Vec3 transparency = Geometry::Vec3(0, 0, 0))
     : ambient_(ambient)
@@ -46,7 +46,7 @@ public:
         return transparency_;
     }
     
-    long double shine() const {
+    Geometry::Real shine() const {
         return shine_;
     }
     
@@ -56,7 +56,7 @@ private:
     Geometry::Vec3 specular_;
     Geometry::Vec3 emit_;
     Geometry::Vec3 transparency_;
-    long double shine_;
+    Geometry::Real shine_;
 };
 
 #endif /* MATERIAL_H */
@@ -0,0 +1,123 @@
+//
+//  material_table.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef material_table_h
+#define material_table_h
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "material.h"
+
+// Shading copy of a Material in floats. Every color takes four lanes so it
+// starts on a 16 byte boundary, the spare lane of the ambient color holds
+// the shine and the other spare lanes are zero.
+class alignas(16) MaterialEntry {
+public:
+    explicit MaterialEntry(const Material& material) {
+        store(material.ambient(), material.shine(), ambient_);
+        store(material.diffuse(), 0, diffuse_);
+        store(material.specular(), 0, specular_);
+        store(material.emit(), 0, emit_);
+        store(material.transparency(), 0, transparency_);
+    }
+    
+    Geometry::Vec3 ambient() const {
+        return load(ambient_);
+    }
+    
+    Geometry::Vec3 diffuse() const {
+        return load(diffuse_);
+    }
+    
+    Geometry::Vec3 specular() const {
+        return load(specular_);
+    }
+    
+    Geometry::Vec3 emit() const {
+        return load(emit_);
+    }
+    
+    Geometry::Vec3 transparency() const {
+        return load(transparency_);
+    }
+    
+    Geometry::Real shine() const {
+        return ambient_[3];
+    }
+    
+    // The light of the surface without any light source
+    Geometry::Vec3 baseIntencity(Geometry::Vec3 global) const {
+        return emit() + ambient() * global;
+    }
+    
+private:
+    float ambient_[4];
+    float diffuse_[4];
+    float specular_[4];
+    float emit_[4];
+    float transparency_[4];
+    
+    static void store(const Geometry::Vec3& color, Geometry::Real last, float* lanes) {
+        for (int k = 0; k < 3; ++k) {
+            lanes[k] = (float) color.vec[k];
+        }
+        lanes[3] = (float) last;
+    }
+    
+    static Geometry::Vec3 load(const float* lanes) {
+        return Geometry::Vec3(lanes[0], lanes[1], lanes[2]);
+    }
+};
+
+// Materials of a scene, objects refer to them by index
+class MaterialTable {
+public:
+    uint32_t add(const Material& material) {
+        return add(MaterialEntry(material));
+    }
+    
+    uint32_t add(const MaterialEntry& entry) {
+        entries_.push_back(entry);
+        return (uint32_t) entries_.size() - 1;
+    }
+    
+    // Appends the entries of the other table, returns the index the first of them got
+    uint32_t append(const MaterialTable& other) {
+        uint32_t first = (uint32_t) entries_.size();
+        entries_.insert(entries_.end(), other.entries_.begin(), other.entries_.end());
+        return first;
+    }
+    
+    const MaterialEntry& operator [](uint32_t index) const {
+        assert(index < entries_.size());
+        return entries_[index];
+    }
+    
+    size_t size() const {
+        return entries_.size();
+    }
+    
+    const MaterialEntry* data() const {
+        return entries_.data();
+    }
+    
+    void clear() {
+        entries_.clear();
+    }
+    
+    size_t memoryUsage() const {
+        return entries_.capacity() * sizeof(MaterialEntry);
+    }
+    
+private:
+    std::vector<MaterialEntry> entries_;
+};
+
+#endif /* material_table_h */
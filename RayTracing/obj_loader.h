@@ -0,0 +1,264 @@
+//
+//  obj_loader.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef obj_loader_h
+#define obj_loader_h
+
+#include <cstdio>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "text_reader.h"
+#include "triangle_mesh.h"
+
+// Reads the geometry of Wavefront OBJ files into a TriangleMesh: v, vn and f
+// statements, faces with more than three corners are split into fans.
+// usemtl picks materials from the mtllib files, of which Ka, Kd, Ks, Ns and
+// Ke are used. Faces without a known material get the default one, texture
+// coordinates, groups and everything else are skipped.
+class ObjLoader {
+public:
+    ObjLoader(const Material& defaultMaterial) : defaultMaterial_(defaultMaterial) { }
+    
+    // Adds the triangles of the file to the mesh and finishes it. A mesh takes
+    // exactly one load, see TriangleMesh::finish().
+    bool load(const std::string& path, TriangleMesh* mesh) {
+        std::ifstream file(path);
+        if (!file) {
+            error_ = "could not open " + path;
+            return false;
+        }
+        
+        size_t slash = path.find_last_of('/');
+        return load(file, slash == std::string::npos ? "" : path.substr(0, slash + 1), mesh);
+    }
+    
+    // Material libraries are looked up in the directory, which ends with a slash or is empty
+    bool load(std::istream& stream, const std::string& directory, TriangleMesh* mesh) {
+        TextReader reader(stream);
+        error_.clear();
+        library_.clear();
+        used_.clear();
+        material_ = NO_MATERIAL;
+        firstVertex_ = (uint32_t) mesh->vertexCount();
+        firstNormal_ = (uint32_t) mesh->normalCount();
+        vertices_ = 0;
+        normals_ = 0;
+        
+        while (reader.nextLine()) {
+            if (!parseStatement(reader, directory, mesh)) {
+                return false;
+            }
+        }
+        if (!stream.eof()) {
+            error_ = "could not read the stream";
+            return false;
+        }
+        
+        mesh->finish();
+        return true;
+    }
+    
+    // Line number and description of the last failure
+    const std::string& error() const {
+        return error_;
+    }
+    
+private:
+    static const uint32_t NO_MATERIAL = 0xFFFFFFFF;
+    
+    Material defaultMaterial_;
+    std::unordered_map<std::string, Material> library_;     // materials of the mtllib files
+    std::unordered_map<std::string, uint32_t> used_;        // library materials already in the mesh
+    std::string name_;                                      // reused for lookups
+    std::vector<uint32_t> face_, faceNormals_;              // reused by faces
+    uint32_t material_;
+    uint32_t firstVertex_, firstNormal_;
+    long vertices_, normals_;                               // read from this file so far
+    std::string error_;
+    
+    bool parseStatement(TextReader& reader, const std::string& directory, TriangleMesh* mesh) {
+        Token command = {NULL, 0};
+        reader.token(&command);
+        
+        if (command == "v") {
+            Geometry::Point3D vertex;
+            if (!reader.number(&vertex)) {
+                return fail(reader, "v expects three coordinates");
+            }
+            mesh->addVertex(vertex);
+            ++vertices_;
+        } else if (command == "vn") {
+            Geometry::Point3D normal;
+            if (!reader.number(&normal)) {
+                return fail(reader, "vn expects three coordinates");
+            }
+            mesh->addNormal(normal);
+            ++normals_;
+        } else if (command == "f") {
+            return parseFace(reader, mesh);
+        } else if (command == "usemtl") {
+            Token name;
+            if (!reader.token(&name)) {
+                return fail(reader, "usemtl expects a name");
+            }
+            return useMaterial(name, mesh);
+        } else if (command == "mtllib") {
+            Token name;
+            while (reader.token(&name)) {
+                if (!loadLibrary(directory + std::string(name.begin, name.length))) {
+                    error_ = "line " + std::to_string(reader.line()) + ": " + error_;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    
+    // Corners are v, v/vt, v//vn or v/vt/vn, indices count from 1 or back from -1
+    bool parseFace(TextReader& reader, TriangleMesh* mesh) {
+        face_.clear();
+        faceNormals_.clear();
+        bool normals = true;
+        
+        Token corner;
+        while (reader.token(&corner)) {
+            const char* end = corner.begin + corner.length;
+            const char* first = std::find(corner.begin, end, '/');
+            const char* second = first == end ? end : std::find(first + 1, end, '/');
+            
+            long vertex;
+            if (!TextReader::parseInteger(corner.begin, first, &vertex) ||
+                !resolve(vertex, vertices_, firstVertex_, &vertex)) {
+                return fail(reader, "bad vertex index", &corner);
+            }
+            face_.push_back((uint32_t) vertex);
+            
+            long normal;
+            if (second == end) {
+                normals = false;
+            } else if (!TextReader::parseInteger(second + 1, end, &normal) ||
+                       !resolve(normal, normals_, firstNormal_, &normal)) {
+                return fail(reader, "bad normal index", &corner);
+            } else {
+                faceNormals_.push_back((uint32_t) normal);
+            }
+        }
+        if (face_.size() < 3) {
+            return fail(reader, "a face needs at least three corners");
+        }
+        
+        if (material_ == NO_MATERIAL) {
+            material_ = mesh->addMaterial(defaultMaterial_);
+        }
+        for (size_t i = 1; i + 1 < face_.size(); ++i) {
+            uint32_t vertices[3] = {face_[0], face_[i], face_[i + 1]};
+            if (normals) {
+                uint32_t normalIds[3] = {faceNormals_[0], faceNormals_[i], faceNormals_[i + 1]};
+                mesh->addTriangle(vertices, material_, normalIds);
+            } else {
+                mesh->addTriangle(vertices, material_);
+            }
+        }
+        return true;
+    }
+    
+    // Index of the mesh array from an OBJ index, false if it's out of range
+    static bool resolve(long index, long count, uint32_t first, long* result) {
+        if (index > 0 && index <= count) {
+            *result = first + index - 1;
+        } else if (index < 0 && -index <= count) {
+            *result = first + count + index;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    bool useMaterial(const Token& name, TriangleMesh* mesh) {
+        name_.assign(name.begin, name.length);
+        auto used = used_.find(name_);
+        if (used != used_.end()) {
+            material_ = used->second;
+            return true;
+        }
+        
+        auto found = library_.find(name_);
+        material_ = mesh->addMaterial(found != library_.end() ? found->second : defaultMaterial_);
+        used_.insert(std::make_pair(name_, material_));
+        return true;
+    }
+    
+    bool loadLibrary(const std::string& path) {
+        // Assets often come without their libraries, the faces just keep the default material
+        std::ifstream file(path);
+        if (!file) {
+            printf("Could not open %s, using the default material\n", path.c_str());
+            return true;
+        }
+        
+        TextReader reader(file);
+        std::string name;
+        Geometry::Vec3 ambient(0, 0, 0), diffuse(0, 0, 0), specular(0, 0, 0), emit(0, 0, 0);
+        Geometry::Real shine = 1;
+        
+        while (reader.nextLine()) {
+            Token command = {NULL, 0};
+            reader.token(&command);
+            
+            bool parsed = true;
+            if (command == "newmtl") {
+                if (!name.empty()) {
+                    library_.insert(std::make_pair(name, Material(ambient, diffuse, specular, shine, emit)));
+                }
+                Token word;
+                parsed = reader.token(&word);
+                if (parsed) {
+                    name.assign(word.begin, word.length);
+                }
+                ambient = diffuse = specular = emit = Geometry::Vec3(0, 0, 0);
+                shine = 1;
+            } else if (command == "Ka") {
+                parsed = reader.number(&ambient);
+            } else if (command == "Kd") {
+                parsed = reader.number(&diffuse);
+            } else if (command == "Ks") {
+                parsed = reader.number(&specular);
+            } else if (command == "Ke") {
+                parsed = reader.number(&emit);
+            } else if (command == "Ns") {
+                parsed = reader.number(&shine);
+            }
+            
+            if (!parsed) {
+                error_ = path + ": ";
+                return fail(reader, "bad material statement", &command);
+            }
+        }
+        if (!name.empty()) {
+            library_.insert(std::make_pair(name, Material(ambient, diffuse, specular, shine, emit)));
+        }
+        return true;
+    }
+    
+    // Appends to error_, which names the material library if the error is in one
+    bool fail(const TextReader& reader, const char* message, const Token* token = NULL) {
+        error_ += "line " + std::to_string(reader.line()) + ": " + message;
+        if (token != NULL) {
+            error_ += " '";
+            error_.append(token->begin, token->length);
+            error_ += "'";
+        }
+        return false;
+    }
+};
+
+#endif /* obj_loader_h */
@@ -11,8 +11,9 @@
 
 #include <vector>
 
-#include "material.h"
+#include "material_table.h"
 #include "geometry.h"
+#include "ray_packet.h"
 
 class Object3D;
 
@@ -21,7 +22,7 @@ public:
     BoundingBox(const std::vector<Object3D*>& objects);
     BoundingBox(Geometry::Point3D low, Geometry::Point3D high) : low_(low), high_(high) { }
     
-    bool contains(const Geometry::Point3D& p) {
+    bool contains(const Geometry::Point3D& p) const {
         if (p.x >= low_.x - Geometry::EPS && p.x <= high_.x + Geometry::EPS &&
             p.y >= low_.y - Geometry::EPS && p.y <= high_.y + Geometry::EPS &&
             p.z >= low_.z - Geometry::EPS && p.z <= high_.z + Geometry::EPS) {
@@ -30,31 +31,34 @@ public:
         return false;
     }
     
-    Geometry::Point3D low() {
+    Geometry::Point3D low() const {
         return low_;
     }
     
-    Geometry::Point3D high() {
+    Geometry::Point3D high() const {
         return high_;
     }
     
-    long double low(int axis) {
+    Geometry::Real low(int axis) const {
         return low_[axis];
     }
     
-    long double high(int axis) {
+    Geometry::Real high(int axis) const {
         return high_[axis];
     }
     
-    long double length(int axis) {
+    Geometry::Real length(int axis) const {
         return high_[axis] - low_[axis];
     }
     
-    std::pair<BoundingBox, BoundingBox> split(int axis, long double proportion) {
+    std::pair<BoundingBox, BoundingBox> split(int axis, Geometry::Real proportion) const {
+        return splitAt(axis, length(axis) * proportion + low_[axis]);
+    }
+    
+    std::pair<BoundingBox, BoundingBox> splitAt(int axis, Geometry::Real axisValue) const {
         Geometry::Point3D high1(high_);
         Geometry::Point3D low2(low_);
         
-        long double axisValue = length(axis) * proportion + low_[axis];
         high1[axis] = axisValue;
         low2 [axis] = axisValue;
         
@@ -68,65 +72,161 @@ public:
         }
     }
     
+    // Shrinks the box to its common part with bBox, false if they don't overlap
+    bool intersectWith(const BoundingBox& bBox) {
+        for (int axis = 0; axis < 3; ++axis) {
+            low_ [axis] = std::max(low_ [axis], bBox.low_ [axis]);
+            high_[axis] = std::min(high_[axis], bBox.high_[axis]);
+            if (low_[axis] > high_[axis]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    Geometry::Real surfaceArea() const {
+        return 2 * (length(0) * length(1) + length(1) * length(2) + length(2) * length(0));
+    }
+    
     bool intersect(Geometry::Point3D start,
                    Geometry::Point3D finish,
                    Geometry::Point3D* crossPoint1,
-                   Geometry::Point3D* crossPoint2) {
+                   Geometry::Point3D* crossPoint2) const {
         
-        Geometry::Point3D guide = (finish - start).normalize();
-        Geometry::Point3D invGuide = 1 / guide;
+        Geometry::Ray ray(start, (finish - start).normalize());
+        Geometry::Real tmin, tmax;
         
-        long double toLow  = invGuide[0] * (low_ [0] - start[0]);
-        long double toHigh = invGuide[0] * (high_[0] - start[0]);
-        long double tmin = std::min(toLow, toHigh);
-        long double tmax = std::max(toLow, toHigh);
-        
-        toLow  = invGuide[1] * (low_ [1] - start[1]);
-        toHigh = invGuide[1] * (high_[1] - start[1]);
-        tmin = std::max(tmin, std::min(toLow, toHigh));
-        tmax = std::min(tmax, std::max(toLow, toHigh));
+        if (clip(ray, &tmin, &tmax)) {
+            *crossPoint1 = ray.at(tmin);
+            *crossPoint2 = ray.at(tmax);
+            
+            return true;
+        }
+        return false;
+    }
+    
+    // Part of [tMin, tMax] of the ray that lies inside the box, false if none.
+    // The sign bits pick the side of every slab the ray enters through, so a
+    // box beyond the closest hit so far is rejected by the same test.
+    bool clip(const Geometry::Ray& ray,
+              Geometry::Real* tNear,
+              Geometry::Real* tFar) const {
         
-        toLow  = invGuide[2] * (low_ [2] - start[2]);
-        toHigh = invGuide[2] * (high_[2] - start[2]);
-        tmin = std::max(tmin, std::min(toLow, toHigh));
-        tmax = std::min(tmax, std::max(toLow, toHigh));
+        Geometry::Real tmin = ray.tMin, tmax = ray.tMax;
+        for (int axis = 0; axis < 3; ++axis) {
+            const Geometry::Point3D& nearSide = ray.sign[axis] ? high_ : low_;
+            const Geometry::Point3D& farSide  = ray.sign[axis] ? low_ : high_;
+            tmin = std::max(tmin, (nearSide[axis] - ray.origin[axis]) * ray.inv[axis]);
+            tmax = std::min(tmax, (farSide [axis] - ray.origin[axis]) * ray.inv[axis]);
+        }
         
-        if ((tmin <= tmax) && (tmax > 0)) {
-            if (tmin > 0) {
-                *crossPoint1 = start + guide * tmin;
-            } else {
-                *crossPoint1 = start;
-            }
-            *crossPoint2 = start + guide * tmax;
-            
+        if (tmin <= tmax) {
+            *tNear = tmin;
+            *tFar = tmax;
             return true;
         }
         return false;
     }
+    
+    // Slab test for all lanes of a packet, the lane misses if tNear > tFar
+    void intersect(const RayPacket& packet, Geometry::Real* tNear, Geometry::Real* tFar) const {
+        for (int i = 0; i < RayPacket::SIZE; ++i) {
+            tNear[i] = 0;
+            tFar[i] = std::numeric_limits<Geometry::Real>::infinity();
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int i = 0; i < RayPacket::SIZE; ++i) {
+                Geometry::Real toLow  = packet.inv[axis][i] * (low_ [axis] - packet.o[axis][i]);
+                Geometry::Real toHigh = packet.inv[axis][i] * (high_[axis] - packet.o[axis][i]);
+                tNear[i] = std::max(tNear[i], std::min(toLow, toHigh));
+                tFar[i]  = std::min(tFar[i],  std::max(toLow, toHigh));
+            }
+        }
+    }
 private:
     Geometry::Point3D low_, high_;
 };
 
 class Object3D {
 public:
-    virtual bool intersect(Geometry::Point3D start, Geometry::Point3D finish, Geometry::Point3D* crossPoint) const = 0;
+    // True if the object crosses the ray within [tMin, tMax), tMax is then
+    // moved to the hit. The ray only ever shrinks, so a series of tests
+    // leaves it at the closest hit of all of them.
+    virtual bool intersect(Geometry::Ray* ray) const = 0;
     virtual Geometry::Point3D normalAt(const Geometry::Point3D& point) const = 0;
     virtual BoundingBox boundingBox() const = 0;
     
-    Geometry::Vec3 baseIntencity(Geometry::Vec3 global) const {
-        return material_.emit() + material_.ambient() * global;
+    // Bounds of the part of the object inside the voxel, false if there is no such part.
+    // The default is the overlap of the boxes, flat objects can do better.
+    virtual bool clippedBoundingBox(const BoundingBox& voxel, BoundingBox* bBox) const {
+        *bBox = boundingBox();
+        return bBox->intersectWith(voxel);
+    }
+    
+    // Intersects the active lanes of the packet, a lane is updated if the hit
+    // lies within [tMin - EPS, tMax + EPS] and is closer than its current one.
+    // Falls back to the scalar test, hot primitives override it.
+    virtual void intersectPacket(RayPacket* packet, const Geometry::Real* tMin, const Geometry::Real* tMax,
+                                 const bool* active) const {
+        for (int i = 0; i < RayPacket::SIZE; ++i) {
+            if (!active[i]) {
+                continue;
+            }
+            
+            Geometry::Ray ray(packet->origin(i), packet->direction(i), tMin[i] - Geometry::EPS,
+                              std::min(tMax[i] + Geometry::EPS, packet->t[i]));
+            if (intersect(&ray)) {
+                packet->t[i] = ray.tMax;
+                packet->object[i] = this;
+            }
+        }
+    }
+    
+    // True if the ray hits the object at a distance within [tMin, tMax]. Shadow
+    // rays only need the answer, hot primitives override it to skip the hit point.
+    virtual bool occludes(const Geometry::Ray& ray) const {
+        Geometry::Ray copy(ray);
+        return intersect(&copy);
     }
     
-    Material material() const {
-        return material_;
+    // Index of the material in the MaterialTable of the scene
+    uint32_t materialId() const {
+        return materialId_;
     }
-protected:
-    Object3D(Material material) : material_(material) { }
+    
+    // For objects whose table is appended to another one
+    void setMaterialId(uint32_t materialId) {
+        materialId_ = materialId;
+    }
+    
     virtual ~Object3D() { }
+protected:
+    explicit Object3D(uint32_t materialId) : materialId_(materialId) { }
+    
 private:
-    Material material_;
+    uint32_t materialId_;
 };
 
+// Bounds of the part of a flat polygon inside the voxel, cut by its six planes
+bool clippedPolygonBox(const Geometry::Point3D* polygon, int count, const BoundingBox& voxel, BoundingBox* bBox) {
+    std::vector<Geometry::Point3D> points(polygon, polygon + count);
+    
+    for (int axis = 0; axis < 3 && !points.empty(); ++axis) {
+        Geometry::clipPolygon(&points, axis, voxel.low(axis), false);
+        Geometry::clipPolygon(&points, axis, voxel.high(axis), true);
+    }
+    if (points.empty()) {
+        return false;
+    }
+    
+    *bBox = BoundingBox(points[0], points[0]);
+    for (size_t i = 1; i < points.size(); ++i) {
+        bBox->expand(BoundingBox(points[i], points[i]));
+    }
+    // Rounding of the cut points must not leak out of the voxel
+    return bBox->intersectWith(voxel);
+}
+
 
 BoundingBox::BoundingBox(const std::vector<Object3D*>& objects)  {
     assert(objects.size() != 0);
@@ -14,5 +14,6 @@
 #include "object3d.h"
 #include "light.h"
 #include "objects_samples.h"
+#include "triangle_mesh.h"
 
 #endif /* OBJECTS_H */
@@ -11,75 +11,139 @@
 
 class Sphere : public Object3D {
 public:
-    Sphere(Geometry::Point3D center, int r, Material material) : Object3D(material), center_(center), r_(r) { }
+    Sphere(Geometry::Point3D center, Geometry::Real r, uint32_t material) : Object3D(material), center_(center), r_(r),
+    r2_(r * r), invR_(1 / r) { }
     
-    virtual bool intersect(Geometry::Point3D start, Geometry::Point3D finish, Geometry::Point3D* crossPoint) const {
-        Geometry::Point3D guide = (finish - start).normalize();
-        
-        long double d2 = ((start - center_) ^ guide).len2() / guide.len2();
-        if (d2 > r_ * r_) {
+    virtual bool intersect(Geometry::Ray* ray) const {
+        Geometry::Real t;
+        if (!cross(ray->origin, ray->direction, ray->tMin, ray->tMax, &t) || t == ray->tMax) {
             return false;
         }
-        
-        if (isOnLine(center_, start, finish)) {
-            *crossPoint = center_ - r_ * guide;
-        } else {
-            Geometry::Point3D t = (center_ - start) ^ guide;
-            Geometry::Point3D n = t ^ guide;
-            n = n.normalize() * sqrt(d2);
+        ray->tMax = t;
+        return true;
+    }
+    
+    // The lanes run the same branch free code as cross()
+    virtual void intersectPacket(RayPacket* packet, const Geometry::Real* tMin, const Geometry::Real* tMax,
+                                 const bool* active) const {
+        for (int i = 0; i < RayPacket::SIZE; ++i) {
+            Geometry::Real cx = center_.x - packet->o[0][i];
+            Geometry::Real cy = center_.y - packet->o[1][i];
+            Geometry::Real cz = center_.z - packet->o[2][i];
+            
+            Geometry::Real tc = cx * packet->d[0][i] + cy * packet->d[1][i] + cz * packet->d[2][i];
+            Geometry::Real px = cx - tc * packet->d[0][i];
+            Geometry::Real py = cy - tc * packet->d[1][i];
+            Geometry::Real pz = cz - tc * packet->d[2][i];
+            Geometry::Real h2 = r2_ - (px * px + py * py + pz * pz);
+            Geometry::Real h = std::sqrt(std::max(h2, (Geometry::Real) 0));
             
-            *crossPoint = center_ + n - guide * sqrt(r_ * r_ - d2);
+            Geometry::Real low = tMin[i] - Geometry::EPS;
+            Geometry::Real t = tc - h >= low ? tc - h : tc + h;
+            bool hit = active[i] && h2 >= 0 && t >= low && t <= tMax[i] + Geometry::EPS && t < packet->t[i];
+            packet->t[i] = hit ? t : packet->t[i];
+            packet->object[i] = hit ? this : packet->object[i];
+        }
+    }
+    
+    virtual bool occludes(const Geometry::Ray& ray) const {
+        Geometry::Real t;
+        return cross(ray.origin, ray.direction, ray.tMin, ray.tMax, &t);
+    }
+    
+    // Nearest root of |start + guide * t - center|^2 = r^2 within [tMin, tMax],
+    // the guide is a unit vector. The discriminant goes through the distance of
+    // the line to the center, |c|^2 - tc^2 cancels badly in float. A ray that
+    // starts inside the sphere gets the far root.
+    bool cross(const Geometry::Point3D& start, const Geometry::Point3D& guide, Geometry::Real tMin, Geometry::Real tMax,
+               Geometry::Real* t) const {
+        Geometry::Point3D c = center_ - start;
+        Geometry::Real tc = c * guide;
+        Geometry::Real h2 = r2_ - (c - guide * tc).len2();
+        if (h2 < 0) {
+            return false;
         }
         
-        return true;
+        Geometry::Real h = std::sqrt(h2);
+        *t = tc - h >= tMin ? tc - h : tc + h;
+        return *t >= tMin && *t <= tMax;
     }
     
     virtual Geometry::Point3D normalAt(const Geometry::Point3D& point) const {
-        return (point - center_).normalize();
+        return (point - center_) * invR_;
     }
     
     virtual BoundingBox boundingBox() const {
         return BoundingBox(center_ - Geometry::Point3D(r_, r_, r_), center_ + Geometry::Point3D(r_, r_, r_));
     }
+    
+    Geometry::Point3D center() const {
+        return center_;
+    }
+    
+    Geometry::Real radius() const {
+        return r_;
+    }
+    
 private:
     Geometry::Point3D center_;
-    int r_;
+    Geometry::Real r_;
+    Geometry::Real r2_, invR_;
 };
 
+// Every polygon keeps its plane. Planar convex polygons also keep the edge
+// functions of their projection on the plane of the two minor axes of the
+// normal, so the inside test is a few multiply-adds per edge, and
+// parallelograms get by with their two edge coordinates. Other polygons take
+// the general point in polygon walk.
 class Polygon : public Object3D {
 public:
-    Polygon(Geometry::Point3D* points, int cnt, Material material, Geometry::Point3D orientation) : Object3D(material),
-    polygon_(points, cnt),
-    orientation_(orientation) { }
+    Polygon(Geometry::Point3D* points, int cnt, uint32_t material, Geometry::Point3D orientation) :
+    Polygon(points, cnt, material, orientation, true) { }
     
-    Polygon(Geometry::Point3D* points, int cnt, Material material) : Polygon(points, cnt, material, Geometry::Point3D(0, 0, 0)) { }
+    Polygon(Geometry::Point3D* points, int cnt, uint32_t material) : Polygon(points, cnt, material, Geometry::Point3D(0, 0, 0)) { }
     
-    virtual bool intersect(Geometry::Point3D start, Geometry::Point3D finish, Geometry::Point3D* crossPoint) const {
-        assert(!areEqual(start, finish));
-        
-        Geometry::Point3D guide = finish - start;
+    virtual bool intersect(Geometry::Ray* ray) const {
+        Geometry::Real t;
+        if (!cross(*ray, &t) || t == ray->tMax) {
+            return false;
+        }
+        ray->tMax = t;
+        return true;
+    }
+    
+    // The plane is tested for all lanes at once, only the lanes that cross it
+    // within their range pay for the inside test
+    virtual void intersectPacket(RayPacket* packet, const Geometry::Real* tMin, const Geometry::Real* tMax,
+                                 const bool* active) const {
+        const Geometry::Point3D& n = normal_;
         
-        Geometry::Point3D norm = normal(); // Normal to the plane
-        long double d = norm * (polygon_[0] - start);
-        long double e = norm * guide;
+        Geometry::Real t[RayPacket::SIZE];
+        bool onPlane[RayPacket::SIZE];
+        for (int i = 0; i < RayPacket::SIZE; ++i) {
+            Geometry::Real e = n.x * packet->d[0][i] + n.y * packet->d[1][i] + n.z * packet->d[2][i];
+            Geometry::Real d = offset_ - (n.x * packet->o[0][i] + n.y * packet->o[1][i] + n.z * packet->o[2][i]);
+            t[i] = d / e;
+            onPlane[i] = active[i] && e != 0 && t[i] >= tMin[i] - Geometry::EPS && t[i] <= tMax[i] + Geometry::EPS &&
+                         t[i] < packet->t[i];
+        }
         
-        if (!Geometry::isZero(e)) {
-            if (Geometry::sign(d) != Geometry::sign(e)) {
-                // sign(d) == 0 mean that line on plane
-                // cross point on line but not on ray
-                return false;
+        for (int i = 0; i < RayPacket::SIZE; ++i) {
+            if (onPlane[i] && contains(packet->origin(i) + packet->direction(i) * t[i])) {
+                packet->t[i] = t[i];
+                packet->object[i] = this;
             }
-            
-            // Let's find cross point then
-            *crossPoint = start + guide * (d / e);
-            
-            return isPointInPolygon(*crossPoint, polygon_);
         }
-        return false;
+    }
+    
+    virtual bool occludes(const Geometry::Ray& ray) const {
+        Geometry::Real t;
+        return cross(ray, &t);
     }
     
     void setOrientation(const Geometry::Point3D& orientation) {
         orientation_ = orientation;
+        orient();
     }
     
     virtual Geometry::Point3D normalAt(const Geometry::Point3D& point) const {
@@ -101,66 +165,242 @@ public:
         return BoundingBox(low, high);
     }
     
+    // Bounds of the polygon clipped by the six planes of the voxel
+    virtual bool clippedBoundingBox(const BoundingBox& voxel, BoundingBox* bBox) const {
+        return clippedPolygonBox(polygon_.points, polygon_.cnt, voxel, bBox);
+    }
+    
+    const Geometry::Polygon3D& polygon() const {
+        return polygon_;
+    }
+    
+    Geometry::Point3D orientation() const {
+        return orientation_;
+    }
+    
 protected:
     Geometry::Polygon3D polygon_;
     SDL_Color color_;
     Geometry::Point3D orientation_;
+    Geometry::Point3D normal_;      // unit normal, turned to the orientation point
+    Geometry::Real offset_;         // normal_ * polygon_[0]
+    
+    // Triangles have their own test and skip the edge functions
+    Polygon(Geometry::Point3D* points, int cnt, uint32_t material, Geometry::Point3D orientation,
+            bool edgeFunctions) : Object3D(material), polygon_(points, cnt), orientation_(orientation),
+    shape_(GENERAL), axisX_(0), axisY_(1) {
+        orient();
+        if (edgeFunctions) {
+            prepareEdges();
+        }
+    }
+    
+    Geometry::Point3D normal() const {
+        return normal_;
+    }
+    
+private:
+    enum Shape {
+        GENERAL,
+        CONVEX,
+        PARALLELOGRAM
+    };
+    
+    // a * x + b * y + c of the projected point, inside the polygon it's at
+    // least 0, and for a parallelogram also at most 1
+    struct EdgeFunction {
+        Geometry::Real a, b, c;
+        
+        Geometry::Real operator ()(Geometry::Real x, Geometry::Real y) const {
+            return a * x + b * y + c;
+        }
+    };
+    
+    Shape shape_;
+    int axisX_, axisY_;                 // axes of the projection
+    std::vector<EdgeFunction> edges_;
     
-    virtual Geometry::Point3D normal() const {
-        Geometry::Point3D normal = ((polygon_[1] - polygon_[0]) ^ (polygon_[2] - polygon_[0])).normalize();
-        if (Geometry::sign(normal * (orientation_ - polygon_[0])) < 0) {
-            normal *= -1;
+    void orient() {
+        normal_ = ((polygon_[1] - polygon_[0]) ^ (polygon_[2] - polygon_[0])).normalize();
+        if (Geometry::sign(normal_ * (orientation_ - polygon_[0])) < 0) {
+            normal_ *= -1;
         }
-        return normal;
+        offset_ = normal_ * polygon_[0];
+    }
+    
+    // The point is on the plane of the polygon
+    bool contains(const Geometry::Point3D& point) const {
+        Geometry::Real x = point[axisX_], y = point[axisY_];
+        switch (shape_) {
+            case PARALLELOGRAM: {
+                Geometry::Real u = edges_[0](x, y), v = edges_[1](x, y);
+                return u >= 0 && u <= 1 && v >= 0 && v <= 1;
+            }
+            case CONVEX:
+                for (size_t i = 0; i < edges_.size(); ++i) {
+                    if (edges_[i](x, y) < 0) {
+                        return false;
+                    }
+                }
+                return true;
+            default:
+                return isPointInPolygon(point, polygon_);
+        }
+    }
+    
+    // Planes crossed out of [tMin, tMax] are rejected before the inside test
+    bool cross(const Geometry::Ray& ray, Geometry::Real* t) const {
+        Geometry::Real e = normal_ * ray.direction;
+        if (e == 0) {
+            return false;
+        }
+        *t = (offset_ - normal_ * ray.origin) / e;
+        return *t >= ray.tMin && *t <= ray.tMax && contains(ray.at(*t));
+    }
+    
+    void prepareEdges() {
+        int cnt = polygon_.cnt;
+        
+        // Drop the dominant axis of the normal, the projection keeps the most area
+        int axis = std::abs(normal_.x) > std::abs(normal_.y) ? (std::abs(normal_.x) > std::abs(normal_.z) ? 0 : 2) :
+                                                               (std::abs(normal_.y) > std::abs(normal_.z) ? 1 : 2);
+        axisX_ = (axis + 1) % 3;
+        axisY_ = (axis + 2) % 3;
+        
+        // Planar within a relative tolerance, the general walk takes the rest
+        Geometry::Real size = 0;
+        for (int i = 1; i < cnt; ++i) {
+            size = std::max(size, (polygon_[i] - polygon_[0]).len());
+        }
+        for (int i = 0; i < cnt; ++i) {
+            if (std::abs(normal_ * polygon_[i] - offset_) > 1e-5 * size) {
+                return;
+            }
+        }
+        
+        std::vector<Geometry::Real> x(cnt), y(cnt);
+        for (int i = 0; i < cnt; ++i) {
+            x[i] = polygon_[i][axisX_];
+            y[i] = polygon_[i][axisY_];
+        }
+        
+        // Convex: every corner turns the same way and the turns add up to one
+        // full circle, not more like the corners of a star
+        int turn = 0;
+        Geometry::Real angle = 0;
+        for (int i = 0; i < cnt; ++i) {
+            int j = (i + 1) % cnt, k = (i + 2) % cnt;
+            Geometry::Real ex = x[j] - x[i], ey = y[j] - y[i];
+            Geometry::Real fx = x[k] - x[j], fy = y[k] - y[j];
+            Geometry::Real cross = ex * fy - ey * fx;
+            int side = cross > 0 ? 1 : (cross < 0 ? -1 : 0);
+            if (side != 0 && turn != 0 && side != turn) {
+                return;
+            }
+            turn = side != 0 ? side : turn;
+            angle += std::atan2(cross, ex * fx + ey * fy);
+        }
+        if (turn == 0 || std::abs(angle) > 3 * Geometry::PI) {
+            return;
+        }
+        
+        if (cnt == 4 && isParallelogram()) {
+            // Coordinates along the edges from the first corner, 0 to 1 inside
+            Geometry::Real e1x = x[1] - x[0], e1y = y[1] - y[0];
+            Geometry::Real e2x = x[3] - x[0], e2y = y[3] - y[0];
+            Geometry::Real det = e1x * e2y - e1y * e2x;
+            EdgeFunction u = {e2y / det, -e2x / det, (e2x * y[0] - e2y * x[0]) / det};
+            EdgeFunction v = {-e1y / det, e1x / det, (e1y * x[0] - e1x * y[0]) / det};
+            edges_.push_back(u);
+            edges_.push_back(v);
+            shape_ = PARALLELOGRAM;
+            return;
+        }
+        
+        for (int i = 0; i < cnt; ++i) {
+            int j = (i + 1) % cnt;
+            Geometry::Real ex = x[j] - x[i], ey = y[j] - y[i];
+            EdgeFunction edge = {-ey * turn, ex * turn, (ey * x[i] - ex * y[i]) * turn};
+            edges_.push_back(edge);
+        }
+        shape_ = CONVEX;
+    }
+    
+    bool isParallelogram() const {
+        Geometry::Point3D gap = polygon_[0] + polygon_[2] - polygon_[1] - polygon_[3];
+        Geometry::Real size = std::max((polygon_[2] - polygon_[0]).len(), (polygon_[3] - polygon_[1]).len());
+        return gap.len() <= 1e-5 * size;
     }
 };
 
+// The plane is kept by the Polygon, the distance to it decides whether a ray
+// gets the watertight edge test at all
 class Triangle : public Polygon {
 public:
-    Triangle(Geometry::Point3D points[3], Material material) : Polygon(points, 3, material) { }
+    Triangle(Geometry::Point3D points[3], uint32_t material) : Polygon(points, 3, material, Geometry::Point3D(0, 0, 0), false) { }
     
-    virtual bool intersect(Geometry::Point3D start, Geometry::Point3D finish, Geometry::Point3D* crossPoint) const {
-        assert(!areEqual(start, finish));
-        
-        Geometry::Point3D guide = finish - start;
+    // Watertight test, a ray through an edge shared with another triangle hits one of them
+    virtual bool intersect(Geometry::Ray* ray) const {
+        Geometry::Real t;
+        if (!cross(*ray, &t) || t == ray->tMax) {
+            return false;
+        }
+        ray->tMax = t;
+        return true;
+    }
+    
+    virtual void intersectPacket(RayPacket* packet, const Geometry::Real* tMin, const Geometry::Real* tMax,
+                                 const bool* active) const {
+        const Geometry::Point3D& n = normal_;
         
-        Geometry::Point3D norm = normal(); // Normal to the plane
-        long double d = norm * (polygon_[0] - start);
-        long double e = norm * guide;
+        Geometry::Real t[RayPacket::SIZE];
+        bool onPlane[RayPacket::SIZE];
+        bool any = false;
+        for (int i = 0; i < RayPacket::SIZE; ++i) {
+            Geometry::Real e = n.x * packet->d[0][i] + n.y * packet->d[1][i] + n.z * packet->d[2][i];
+            Geometry::Real d = offset_ - (n.x * packet->o[0][i] + n.y * packet->o[1][i] + n.z * packet->o[2][i]);
+            t[i] = d / e;
+            onPlane[i] = active[i] & (e != 0) & (t[i] >= tMin[i] - Geometry::EPS) & (t[i] <= tMax[i] + Geometry::EPS) &
+                         (t[i] < packet->t[i]);
+            any |= onPlane[i];
+        }
+        if (!any) {
+            return;
+        }
         
-        if (!Geometry::isZero(e)) {
-            if (Geometry::sign(d) != Geometry::sign(e)) {
-                // sign(d) == 0 means that line on plane
-                // cross point on line but not on ray
-                return false;
-            }
-            
-            // Let's find cross point then
-            *crossPoint = start + guide * (d / e);
-            
-            // Find normals
-            Geometry::Point3D norm[3] = {
-                (polygon_[0] - *crossPoint) ^ (polygon_[1] - *crossPoint),
-                (polygon_[1] - *crossPoint) ^ (polygon_[2] - *crossPoint),
-                (polygon_[2] - *crossPoint) ^ (polygon_[0] - *crossPoint)
-            };
-            
-            // If they have same orientation
-            int sum = Geometry::sign(norm[0] * norm[1]) +
-            Geometry::sign(norm[1] * norm[2]) +
-            Geometry::sign(norm[2] * norm[0]);
-            
-            if (sum == 3 || sum == -3) {
-                return true;
-            }
+        Geometry::Real U[RayPacket::SIZE], V[RayPacket::SIZE], W[RayPacket::SIZE];
+        bool hit[RayPacket::SIZE];
+        packet->triangleEdges(polygon_[0], polygon_[1], polygon_[2], onPlane, U, V, W, hit);
+        for (int i = 0; i < RayPacket::SIZE; ++i) {
+            packet->t[i] = hit[i] ? t[i] : packet->t[i];
+            packet->object[i] = hit[i] ? this : packet->object[i];
+        }
+    }
+    
+    virtual bool occludes(const Geometry::Ray& ray) const {
+        Geometry::Real t;
+        return cross(ray, &t);
+    }
+    
+private:
+    // Only the edge functions depend on the vertices, the distance comes from
+    // the plane and rays crossing it out of [tMin, tMax] stop there
+    bool cross(const Geometry::Ray& ray, Geometry::Real* t) const {
+        Geometry::Real e = normal_ * ray.direction;
+        if (e == 0) {
+            return false;
         }
-        return false;
+        *t = (offset_ - normal_ * ray.origin) / e;
+        
+        Geometry::Real U, V, W;
+        return *t >= ray.tMin && *t <= ray.tMax &&
+               Geometry::triangleEdges(ray.origin, ray.shear, polygon_[0], polygon_[1], polygon_[2], &U, &V, &W);
     }
 };
 
 class Quadrangle : public Polygon {
 public:
-    Quadrangle(Geometry::Point3D points[4], Material material) : Polygon(points, 4, material) { }
+    Quadrangle(Geometry::Point3D points[4], uint32_t material) : Polygon(points, 4, material) { }
 };
 
 
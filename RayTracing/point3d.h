@@ -15,19 +15,19 @@
 namespace Geometry {
     
     struct Point3D {
-        long double x, y, z;
+        Real x, y, z;
         
         Point3D() {}
-        Point3D(long double x, long double y, long double z);
+        Point3D(Real x, Real y, Real z);
         
         Point3D getNormalized() const;
         Point3D& normalize();
         
-        long double len2() const;
-        long double len()  const;
+        Real len2() const;
+        Real len()  const;
         
-        long double& operator[] (int axis);
-        const long double operator[] (int axis) const;
+        Real& operator[] (int axis);
+        const Real operator[] (int axis) const;
         
         Point3D& operator +=(const Point3D& p);
         Point3D& operator -=(const Point3D& p);
@@ -36,12 +36,12 @@ namespace Geometry {
         Point3D operator -();
         Point3D operator +();
         
-        Point3D& operator *=(long double a);
-        Point3D& operator /=(long double a);
+        Point3D& operator *=(Real a);
+        Point3D& operator /=(Real a);
     };
     
 
-    Point3D::Point3D(long double x, long double y, long double z) : x(x), y(y), z(z) { }
+    Point3D::Point3D(Real x, Real y, Real z) : x(x), y(y), z(z) { }
     
     
     Point3D& Point3D::operator +=(const Point3D& p) {
@@ -68,14 +68,14 @@ namespace Geometry {
         return *this;
     }
     
-    Point3D& Point3D::operator *=(long double a) {
+    Point3D& Point3D::operator *=(Real a) {
         this->x *= a;
         this->y *= a;
         this->z *= a;
         return *this;
     }
     
-    Point3D& Point3D::operator /=(long double a) {
+    Point3D& Point3D::operator /=(Real a) {
         this->x /= a;
         this->y /= a;
         this->z /= a;
@@ -94,19 +94,19 @@ namespace Geometry {
         return p1 ^= p2;
     }
     
-    Point3D operator *(Point3D p, long double a) {
+    Point3D operator *(Point3D p, Real a) {
         return p *= a;
     }
     
-    Point3D operator *(long double a, Point3D p) {
+    Point3D operator *(Real a, Point3D p) {
         return p *= a;
     }
     
-    Point3D operator /(Point3D p, long double a) {
+    Point3D operator /(Point3D p, Real a) {
         return p /= a;
     }
     
-    Point3D operator /(long double a, const Point3D& p) {
+    Point3D operator /(Real a, const Point3D& p) {
         return Point3D(a / p.x, a / p.y, a / p.z);
     }
     
@@ -118,19 +118,19 @@ namespace Geometry {
         return Point3D(*this);
     }
     
-    long double operator *(const Point3D& p1, const Point3D& p2) {
+    Real operator *(const Point3D& p1, const Point3D& p2) {
         return p1.x * p2.x + p1.y * p2.y + p1.z * p2.z;
     }
     
-    long double Point3D::len2() const {
+    Real Point3D::len2() const {
         return x * x + y * y + z * z;
     }
     
-    long double Point3D::len() const {
-        return sqrt(len2());
+    Real Point3D::len() const {
+        return std::sqrt(len2());
     }
     
-    const long double Point3D::operator[](int axis) const {
+    const Real Point3D::operator[](int axis) const {
         assert(axis >= 0);
         assert(axis <= 3);
         
@@ -143,7 +143,7 @@ namespace Geometry {
         }
     }
     
-    long double& Point3D::operator[](int axis) {
+    Real& Point3D::operator[](int axis) {
         assert(axis >= 0);
         assert(axis <= 3);
         
@@ -9,6 +9,8 @@
 #ifndef polygon3d_h
 #define polygon3d_h
 
+#include <cstring>
+
 #include "point3d.h"
 
 namespace Geometry {
@@ -0,0 +1,199 @@
+//
+//  progressive.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef progressive_h
+#define progressive_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+#include "sampler.h"
+
+// Where the rays of one pass go. A pass traces one ray per block x block
+// pixels, through the point (dx, dy) of the block given in fractions of its
+// size. Passes with block 1 add one sample to every pixel, samples is the
+// count every pixel has after the pass. Bigger blocks only give a preview and
+// keep no samples.
+struct SamplePass {
+    Geometry::Real dx, dy;
+    int block;
+    int samples;
+    
+    // The preview traces the centers of the blocks
+    static SamplePass preview(int block) {
+        SamplePass pass = {0.5, 0.5, block, 0};
+        return pass;
+    }
+    
+    // Sample n of every pixel, counted from 0
+    static SamplePass sample(const SamplePattern& pattern, int n) {
+        SamplePass pass = {pattern.x(n), pattern.y(n), 1, n + 1};
+        return pass;
+    }
+};
+
+// Budget of RayTracer::renderProgressive(), it stops at whichever limit
+// comes first. A zero limit doesn't count, with both zero one sample is taken.
+// With a positive threshold the sampling is adaptive: once every pixel has
+// uniformSamples, only the pixels AccumulationBuffer::refine() keeps get more.
+struct ProgressiveParams {
+    int samples;                // per pixel, at most
+    double seconds;             // no pass is started that is expected to end later
+    int previewBlock;           // the first pass traces one ray per block, 1 skips it
+    int uniformSamples;
+    Geometry::Real threshold;   // of the standard error of the luminance of a pixel
+    Geometry::Real contrast;    // of the luminance of neighbours that makes an edge
+    
+    ProgressiveParams() : samples(1), seconds(0), previewBlock(4), uniformSamples(4), threshold(0),
+        contrast(1.0 / 32) { }
+};
+
+// Sums of the samples of every pixel in floats, with what the adaptive
+// sampling needs to judge a pixel: the count, the sum of the squared
+// luminances and the object the samples hit. A pass adds one sample to each
+// pixel that is still active, all of them have the same count then.
+class AccumulationBuffer {
+public:
+    AccumulationBuffer() : width_(0), height_(0) { }
+    
+    // Drops the samples and sets the size, every pixel is active
+    void reset(int width, int height) {
+        width_ = width;
+        height_ = height;
+        sums_.assign((size_t) width * height * 3, 0.0f);
+        squares_.assign((size_t) width * height, 0.0f);
+        counts_.assign((size_t) width * height, 0);
+        objects_.assign((size_t) width * height, NULL);
+        flags_.assign((size_t) width * height, 0);
+    }
+    
+    // Returns the new sum of the pixel. The object is the one the sample hit,
+    // NULL if it missed the scene.
+    Geometry::Vec3 add(int x, int y, const Geometry::Vec3& color, const void* object) {
+        size_t pixel = (size_t) y * width_ + x;
+        float* sum = &sums_[pixel * 3];
+        sum[0] += (float) color[0];
+        sum[1] += (float) color[1];
+        sum[2] += (float) color[2];
+        
+        float luminance = luma(color);
+        squares_[pixel] += luminance * luminance;
+        if (counts_[pixel]++ == 0) {
+            objects_[pixel] = object;
+        } else if (objects_[pixel] != object) {
+            flags_[pixel] |= MIXED;
+        }
+        return Geometry::Vec3(sum[0], sum[1], sum[2]);
+    }
+    
+    bool active(int x, int y) const {
+        return (flags_[(size_t) y * width_ + x] & DONE) == 0;
+    }
+    
+    // Retires the active pixels that need no more samples and returns how
+    // many remain. A pixel stays active while the standard error of its mean
+    // luminance exceeds the threshold or it lies on an edge: its samples hit
+    // different objects, a neighbour saw another object first or its mean
+    // luminance differs from a neighbour's by more than the contrast, as at
+    // the border of a shadow. Edges get every sample up to the limit, a
+    // uniform render would give them as many.
+    size_t refine(int maxSamples, Geometry::Real threshold, Geometry::Real contrast) {
+        size_t remaining = 0;
+        for (int y = 0; y < height_; ++y) {
+            for (int x = 0; x < width_; ++x) {
+                size_t pixel = (size_t) y * width_ + x;
+                if (flags_[pixel] & DONE) {
+                    continue;
+                }
+                if ((maxSamples > 0 && counts_[pixel] >= (uint32_t) maxSamples) ||
+                    (!onEdge(x, y, contrast) && error(pixel) <= threshold)) {
+                    flags_[pixel] |= DONE;
+                } else {
+                    ++remaining;
+                }
+            }
+        }
+        return remaining;
+    }
+    
+    int width() const {
+        return width_;
+    }
+    
+    int height() const {
+        return height_;
+    }
+    
+private:
+    enum {
+        MIXED = 1,      // the samples hit different objects
+        DONE = 2        // takes no more samples
+    };
+    
+    int width_, height_;
+    std::vector<float> sums_;       // RGB, rows top to bottom
+    std::vector<float> squares_;
+    std::vector<uint32_t> counts_;
+    std::vector<const void*> objects_;  // hit by the first sample
+    std::vector<uint8_t> flags_;
+    
+    static float luma(const Geometry::Vec3& color) {
+        return (float) (0.2126 * color[0] + 0.7152 * color[1] + 0.0722 * color[2]);
+    }
+    
+    Geometry::Real mean(size_t pixel) const {
+        const float* sum = &sums_[pixel * 3];
+        return luma(Geometry::Vec3(sum[0], sum[1], sum[2])) / std::max((uint32_t) 1, counts_[pixel]);
+    }
+    
+    bool onEdge(int x, int y, Geometry::Real contrast) const {
+        size_t pixel = (size_t) y * width_ + x;
+        if (flags_[pixel] & MIXED) {
+            return true;
+        }
+        
+        size_t neighbours[4];
+        int count = 0;
+        if (x > 0) {
+            neighbours[count++] = pixel - 1;
+        }
+        if (x + 1 < width_) {
+            neighbours[count++] = pixel + 1;
+        }
+        if (y > 0) {
+            neighbours[count++] = pixel - width_;
+        }
+        if (y + 1 < height_) {
+            neighbours[count++] = pixel + width_;
+        }
+        
+        Geometry::Real luminance = mean(pixel);
+        for (int i = 0; i < count; ++i) {
+            if (objects_[neighbours[i]] != objects_[pixel] ||
+                std::abs(mean(neighbours[i]) - luminance) > contrast) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    Geometry::Real error(size_t pixel) const {
+        uint32_t samples = counts_[pixel];
+        if (samples < 2) {
+            return 0;
+        }
+        Geometry::Real average = mean(pixel);
+        Geometry::Real variance = (squares_[pixel] - samples * average * average) / (samples - 1);
+        return std::sqrt(std::max((Geometry::Real) 0, variance) / samples);
+    }
+};
+
+#endif /* progressive_h */
@@ -11,31 +11,158 @@
 
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <memory>
+#include <string>
 #include <vector>
 #include "window.h"
+#include "framebuffer.h"
 #include "objects.h"
-#include "kdTree.h"
+#include "accelerator.h"
+#include "linear_kd_tree.h"
+#include "bvh.h"
+#include "bvh4.h"
+#include "tile_scheduler.h"
+#include "ray_packet.h"
+#include "shading_batch.h"
+#include "light_grid.h"
+#include "progressive.h"
+#include "scene_arena.h"
+#include "scene_parser.h"
+#include "scene_cache.h"
 
 using namespace Geometry;
 
 class RayTracer {
 public:
-    RayTracer(std::istream stream) {
-        
+    // Reads the scene from a .rt stream, the scene stays empty if it can't be parsed
+    RayTracer(std::istream& stream) : RayTracer(Point3D(0, 0, 0), Window()) {
+        load(stream);
     }
-    RayTracer(Point3D origin, Window window) : origin_(origin), window_(window) { }
+    RayTracer(Point3D origin, Window window) : origin_(origin), window_(std::move(window)),
+        accelerator_(new LinearKDTree()), acceleratorType_(ACCELERATOR_KD_TREE),
+        threads_(TileScheduler::defaultThreads()), tileSize_(16), packets_(true),
+        kdBuilder_(KD_BUILDER_BINNED), treeBuilt_(false), lightCutoff_(LIGHT_CUTOFF), lightsIndexed_(false),
+        buildSeconds_(0), renderSeconds_(0), rays_(0) { }
     
-    ~RayTracer() {
-        objects_.clear();
+    // Objects refer to the material by the returned id
+    uint32_t addMaterial(const Material& material) {
+        return materials_.add(material);
     }
     
+    // Constructs the object in the arena of the scene and adds it
+    template <class T, class... Args>
+    T* createObject(Args&&... args) {
+        T* object = arena_.create<T>(std::forward<Args>(args)...);
+        addObject(object);
+        return object;
+    }
+    
+    template <class... Args>
+    Light* createLight(Args&&... args) {
+        Light* light = arena_.create<Light>(std::forward<Args>(args)...);
+        addLight(light);
+        return light;
+    }
+    
+    // An empty mesh that lives as long as the scene, finish it and pass it to addMesh()
+    TriangleMesh* createMesh() {
+        return arena_.create<TriangleMesh>();
+    }
+    
+    // Objects that aren't created by the tracer must outlive it
     void addObject(Object3D* object) {
         objects_.push_back(object);
+        treeBuilt_ = false;
+    }
+    
+    // The objects and materials of a finished mesh, the mesh has to outlive
+    // the scene and can only be added once
+    void addMesh(TriangleMesh* mesh) {
+        uint32_t first = (uint32_t) materials_.size();
+        for (auto& material : mesh->materials()) {
+            materials_.add(material);
+        }
+        for (size_t i = 0; i < mesh->triangleCount(); ++i) {
+            MeshTriangle* triangle = mesh->triangle(i);
+            triangle->setMaterialId(first + triangle->materialId());
+            addObject(triangle);
+        }
     }
     
     void addLight(Light* light) {
         lights_.push_back(light);
+        lightsIndexed_ = false;
+    }
+    
+    // Drops the acceleration structure and destroys the objects, lights and
+    // meshes the tracer created, the camera and the settings stay
+    void clear() {
+        accelerator_.reset(createAccelerator());
+        treeBuilt_ = false;
+        objects_.clear();
+        lights_.clear();
+        lightsIndexed_ = false;
+        materials_.clear();
+        arena_.reset();
+    }
+    
+    // Bytes held by the objects, lights and meshes of the scene arena
+    size_t sceneMemoryUsage() const {
+        return arena_.memoryUsage();
+    }
+    
+    // Adds the objects and lights of a .rt stream and takes its camera and window
+    bool load(std::istream& stream) {
+        SceneParser parser;
+        SceneDescription scene;
+        if (!parser.parse(stream, &scene)) {
+            printf("Could not load the scene: %s\n", parser.error().c_str());
+            return false;
+        }
+        
+        takeScene(&scene);
+        treeBuilt_ = false;
+        return true;
+    }
+    
+    // Loads a .rt stream into the empty tracer through a cache file. The cache
+    // is used if it was written for the same source and acceleration structure,
+    // otherwise the source is parsed, the structure built and the cache rewritten.
+    bool load(std::istream& stream, const std::string& cachePath) {
+        assert(objects_.empty() && lights_.empty());
+        
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t hash = hashStream(stream);
+        stream.clear();
+        stream.seekg(0);
+        
+        SceneDescription scene;
+        std::unique_ptr<Accelerator> accelerator(createAccelerator());
+        if (SceneCache::read(cachePath, hash, cacheKey(), &scene, accelerator.get())) {
+            takeScene(&scene);
+            accelerator_ = std::move(accelerator);
+            treeBuilt_ = true;
+            buildSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            return true;
+        }
+        
+        if (!load(stream)) {
+            return false;
+        }
+        buildTree();
+        
+        scene.origin = origin_;
+        scene.leftTop = window_.leftTop();
+        scene.rightTop = window_.rightTop();
+        scene.leftBottom = window_.leftBottom();
+        scene.objects = objects_;
+        scene.lights = lights_;
+        scene.materials = materials_;
+        SceneCache::write(cachePath, hash, cacheKey(), scene, *accelerator_);
+        return true;
     }
     
     bool start() {
@@ -46,104 +173,349 @@ public:
         window_.close();
     }
     
-    void setPixelColor(int x, int y, SDL_Color color) {
-        window_.setPixelColor(x, y, color);
+    // Renders the scene and shows it if the window is opened
+    void draw() {
+        render();
+        
+        if (window_.isOpen()) {
+            window_.present(framebuffer_);
+        }
     }
     
-    void draw() {
-        kdTree = new KDNode(objects_);
-        kdTree->build();
-        window_.begin();
+    // Renders progressively and shows every pass if the window is opened.
+    // Returns false if the window was closed before the last pass.
+    bool drawProgressive(const ProgressiveParams& params) {
+        bool closed = false;
+        renderProgressive(params, [this, &closed](const Framebuffer& framebuffer, int /*samples*/) {
+            if (window_.isOpen()) {
+                window_.present(framebuffer);
+                closed = shouldClose();
+            }
+            return !closed;
+        });
+        return !closed;
+    }
+    
+    // Builds the chosen acceleration structure over the objects on the render threads
+    void buildTree() {
+        auto begin = std::chrono::steady_clock::now();
         
-        int allias = 1;
-        Point3D* rays = new Point3D[allias];
-
-        for (int w = 0; w < window_.getPixelWidth(); ++w) {
-            for (int h = 0; h < window_.getPixelHeight(); ++h) {
-                Object3D* crossObject;
-                Point3D crossPoint;
-                Vec3 color = Vec3(0, 0, 0);
-                
-                window_.getPixelPoints(w, h, rays, allias);
-                for (int i = 0; i < allias; ++i) {
-                    if (traceRay(origin_, rays[i], &crossObject, &crossPoint)) {
-                        
-                        Vec3 lightEnergy = crossObject->baseIntencity(Vec3(0.7, 0.7, 0.7));
-                        
-                        for (auto light : lights_) {
-                            Object3D* tmpObject;
-                            Point3D tmpPoint;
-                            if (traceRay(light->position(), crossPoint, &tmpObject, &tmpPoint)) {
-                                if (areEqual(crossPoint, tmpPoint)) {
-                                    lightEnergy += light->intencityAt(crossPoint, *crossObject, origin_);
-                                }
-                            }
-                        }
-                        
-                        color += lightEnergy.limit(0, 1);
+        accelerator_.reset(createAccelerator());
+        accelerator_->build(objects_, threads_);
+        treeBuilt_ = true;
+        
+        buildSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+    
+    // False once the objects or the choice of structure changed since the last buildTree()
+    bool treeBuilt() const {
+        return treeBuilt_;
+    }
+    
+    // Takes effect on the next buildTree()
+    void setAccelerator(AcceleratorType type) {
+        acceleratorType_ = type;
+        treeBuilt_ = false;
+    }
+    
+    // The params are only used by the exact builder
+    void setKDBuilder(KDBuilder builder, const KDBuildParams& params = KDBuildParams()) {
+        kdBuilder_ = builder;
+        kdParams_ = params;
+        treeBuilt_ = false;
+    }
+    
+    const Accelerator& accelerator() const {
+        return *accelerator_;
+    }
+    
+    // Where the samples of progressive renders go, the first is always the pixel center
+    void setSampler(SamplerType type) {
+        if (type != pattern_.type()) {
+            pattern_ = SamplePattern(type);
+        }
+    }
+    
+    // A light is left out where it would add less than the cutoff to every
+    // channel, 0 keeps every light everywhere
+    void setLightCutoff(Real cutoff) {
+        lightCutoff_ = cutoff;
+        lightsIndexed_ = false;
+    }
+    
+    // Renders the scene into the framebuffer, doesn't need SDL
+    void render() {
+        prepareRender();
+        
+        auto begin = std::chrono::steady_clock::now();
+        rays_ = renderPass(SamplePass::sample(pattern_, 0));
+        renderSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+    
+    // Renders pass after pass, every pass adds a sample to every active pixel
+    // and the framebuffer holds their average. Adaptive renders retire pixels
+    // after each pass once they have params.uniformSamples, and stop when
+    // none is left. onPass(framebuffer, samples) is called after each pass
+    // and stops the rendering by returning false. A preview pass with one ray
+    // per params.previewBlock pixels comes first and gets samples 0. rays()
+    // and renderSeconds() cover all passes.
+    template <class OnPass>
+    void renderProgressive(const ProgressiveParams& params, OnPass onPass) {
+        prepareRender();
+        
+        auto begin = std::chrono::steady_clock::now();
+        rays_ = 0;
+        bool go = true;
+        if (params.previewBlock > 1) {
+            rays_ += renderPass(SamplePass::preview(params.previewBlock));
+            go = onPass(framebuffer_, 0);
+        }
+        
+        int samples = params.samples > 0 || params.seconds > 0 ? params.samples : 1;
+        for (int n = 0; go && (samples == 0 || n < samples); ++n) {
+            auto passBegin = std::chrono::steady_clock::now();
+            rays_ += renderPass(SamplePass::sample(pattern_, n));
+            if (params.threshold > 0 && n + 1 >= params.uniformSamples) {
+                go = accumulation_.refine(samples, params.threshold, params.contrast) > 0;
+            }
+            auto end = std::chrono::steady_clock::now();
+            go = onPass(framebuffer_, n + 1) && go;
+            
+            // The next pass would take about as long as this one
+            double spent = std::chrono::duration<double>(end - begin).count();
+            double pass = std::chrono::duration<double>(end - passBegin).count();
+            if (params.seconds > 0 && spent + pass > params.seconds) {
+                break;
+            }
+        }
+        renderSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+    
+    // Primary and shadow rays traced by the last render()
+    size_t rays() const {
+        return rays_;
+    }
+    
+    // Wall clock time of the last buildTree() and of the tracing part of the last render()
+    // or renderProgressive()
+    // Loading the structure from a cache counts as building it
+    double buildSeconds() const {
+        return buildSeconds_;
+    }
+    
+    double renderSeconds() const {
+        return renderSeconds_;
+    }
+    
+    // Returns the number of rays traced. The tile is cut into cells of
+    // pass.block pixels with one ray each, passes with samples only trace the
+    // pixels that are still active. The hits are shaded in batches. Every
+    // pixel of a cell gets its color, passes with samples add it to the
+    // accumulation buffer and show the average.
+    size_t renderTile(const Tile& tile, const SamplePass& pass) {
+        int columns = (tile.x1 - tile.x0 + pass.block - 1) / pass.block;
+        int rows = (tile.y1 - tile.y0 + pass.block - 1) / pass.block;
+        std::vector<int> cells;     // row * columns + column, row by row
+        cells.reserve(columns * rows);
+        for (int row = 0; row < rows; ++row) {
+            for (int column = 0; column < columns; ++column) {
+                if (pass.samples == 0 || accumulation_.active(tile.x0 + column, tile.y0 + row)) {
+                    cells.push_back(row * columns + column);
+                }
+            }
+        }
+        if (cells.empty()) {
+            return 0;
+        }
+        
+        // A multiply per column and row of the tile, the rays only add them
+        Point3D corner, right, down;
+        window_.getPixelGrid(&corner, &right, &down);
+        std::vector<Point3D> columnPoints(columns), rowOffsets(rows);
+        for (int column = 0; column < columns; ++column) {
+            int x = tile.x0 + column * pass.block;
+            columnPoints[column] = corner + right * (x + pass.dx * std::min(pass.block, tile.x1 - x));
+        }
+        for (int row = 0; row < rows; ++row) {
+            int y = tile.y0 + row * pass.block;
+            rowOffsets[row] = down * (y + pass.dy * std::min(pass.block, tile.y1 - y));
+        }
+        std::vector<Point3D> points(cells.size());
+        for (size_t i = 0; i < cells.size(); ++i) {
+            points[i] = columnPoints[cells[i] % columns] + rowOffsets[cells[i] / columns];
+        }
+        
+        std::vector<Vec3> colors(columns * rows, Vec3(0, 0, 0));
+        std::vector<const Object3D*> objects(columns * rows, NULL);
+        ShadingBatch batch;
+        std::vector<uint32_t> lights;   // reused by every batch of the tile
+        
+        size_t traced = packets_ ?
+            traceTilePackets(cells, points, &batch, &lights, colors.data(), objects.data()) :
+            traceTileRays(cells, points, &batch, &lights, colors.data(), objects.data());
+        traced += shadeBatch(&batch, &lights, colors.data());
+        
+        for (int cell : cells) {
+            int x0 = tile.x0 + cell % columns * pass.block;
+            int y0 = tile.y0 + cell / columns * pass.block;
+            for (int h = y0; h < std::min(y0 + pass.block, tile.y1); ++h) {
+                for (int w = x0; w < std::min(x0 + pass.block, tile.x1); ++w) {
+                    Vec3 color = colors[cell];
+                    if (pass.samples > 0) {
+                        color = accumulation_.add(w, h, color, objects[cell]) / pass.samples;
                     }
+                    framebuffer_.setPixel(w, h, color);
+                }
+            }
+        }
+        return traced;
+    }
+    
+    // The rays of the cells go through the points, both in the same order
+    size_t traceTileRays(const std::vector<int>& cells, const std::vector<Point3D>& points, ShadingBatch* batch,
+                         std::vector<uint32_t>* lights, Vec3* colors, const Object3D** objects) {
+        size_t traced = 0;
+        for (size_t i = 0; i < cells.size(); ++i) {
+            Object3D* crossObject;
+            Point3D crossPoint;
+            traced += 1;
+            if (traceRay(origin_, points[i], &crossObject, &crossPoint)) {
+                objects[cells[i]] = crossObject;
+                traced += addHit(batch, lights, colors, *crossObject, crossPoint, cells[i]);
+            }
+        }
+        return traced;
+    }
+    
+    // Primary rays of RayPacket::SIZE consecutive cells go through the tree
+    // together, mostly they are neighbours in a row
+    size_t traceTilePackets(const std::vector<int>& cells, const std::vector<Point3D>& points, ShadingBatch* batch,
+                            std::vector<uint32_t>* lights, Vec3* colors, const Object3D** objects) {
+        size_t traced = 0;
+        for (size_t first = 0; first < cells.size(); first += RayPacket::SIZE) {
+            int count = (int) std::min((size_t) RayPacket::SIZE, cells.size() - first);
+            RayPacket packet;
+            for (int lane = 0; lane < count; ++lane) {
+                packet.add(origin_, points[first + lane]);
+            }
+            
+            tracePacket(&packet);
+            traced += count;
+            for (int lane = 0; lane < count; ++lane) {
+                if (packet.object[lane] != NULL) {
+                    objects[cells[first + lane]] = packet.object[lane];
+                    traced += addHit(batch, lights, colors, *packet.object[lane], packet.hitPoint(lane),
+                                     cells[first + lane]);
                 }
-                
-                color /= allias;
-                
-                window_.setPixelColor(w, h, makeRGBA(color));
+            }
+        }
+        return traced;
+    }
+    
+    // Queues the hit for shading, a full batch is shaded first. Returns the
+    // number of shadow rays cast for the full batch.
+    size_t addHit(ShadingBatch* batch, std::vector<uint32_t>* lights, Vec3* colors, const Object3D& crossObject,
+                  const Point3D& crossPoint, int pixel) const {
+        size_t traced = batch->full() ? shadeBatch(batch, lights, colors) : 0;
+        batch->add(crossObject, materials_[crossObject.materialId()], crossPoint, origin_, Vec3(0.7, 0.7, 0.7),
+                   pixel);
+        return traced;
+    }
+    
+    // Light by light: the shadow rays of all hits, then the light adds to the
+    // visible ones. Only the lights the grid finds near the hits are asked and
+    // hits out of the reach of a light cast no shadow ray to it. Every hit adds
+    // its color to colors[target] and the batch is emptied. The lights vector
+    // is scratch space kept by the caller. Returns the number of shadow rays.
+    size_t shadeBatch(ShadingBatch* batch, std::vector<uint32_t>* lights, Vec3* colors) const {
+        bool visible[ShadingBatch::CAPACITY];
+        size_t traced = 0;
+        lights->clear();
+        lightGrid_.query(*batch, lights);
+        for (uint32_t index : *lights) {
+            const Light* light = lights_[index];
+            Point3D position = light->position();
+            Real reach2 = lightGrid_.reach2(index);
+            bool any = false;
+            for (int i = 0; i < batch->count; ++i) {
+                Point3D hit = batch->hitPoint(i);
+                bool reached = (hit - position).len2() < reach2;
+                visible[i] = reached && !occluded(position, hit);
+                traced += reached;
+                any |= visible[i];
+            }
+            if (any) {
+                light->illuminate(batch, visible);
             }
         }
         
-        window_.end();
+        for (int i = 0; i < batch->count; ++i) {
+            Vec3 color(batch->color[0][i], batch->color[1][i], batch->color[2][i]);
+            colors[batch->target[i]] += color.limit(0, 1);
+        }
+        batch->clear();
+        return traced;
+    }
+    
+    // Number of render threads, 1 renders on the calling thread
+    void setThreads(int threads) {
+        threads_ = threads;
+    }
+    
+    void setTileSize(int tileSize) {
+        tileSize_ = tileSize;
+    }
+    
+    // Trace primary rays in packets of RayPacket::SIZE
+    void setPackets(bool packets) {
+        packets_ = packets;
+    }
+    
+    const Framebuffer& framebuffer() const {
+        return framebuffer_;
     }
     
     bool traceRay(const Point3D& start, const Point3D& finish,
-                  Object3D** crossObject, Point3D* crossPoint)
+                  Object3D** crossObject, Point3D* crossPoint) const
     {
         assert(crossObject != NULL);
         
-        *crossObject = NULL;
+        Ray ray(start, (finish - start).normalize(), EPS);
+        if (!accelerator_->intersect(&ray, crossObject)) {
+            return false;
+        }
+        *crossPoint = ray.at(ray.tMax);
+        return true;
+    }
+    
+    // Shadow ray query: true if something lies between the points
+    bool occluded(const Point3D& from, const Point3D& to) const {
+        Point3D guide = to - from;
+        Real length = guide.len();
         
-        std::vector<std::pair<KDNode*, Point3D>> stack;
-        KDNode* currentNode = kdTree;
-        Point3D near, far;
-        if (kdTree->intersect(start, finish, &near, &far)) {
-            
-            while (*crossObject == NULL) {
-                if (currentNode->isLeaf()) {
-                    Point3D tmpPoint;
-                    for (int i = 0; i < currentNode->objects_.size(); ++i) {
-                        if (currentNode->objects_[i]->intersect(start, finish, &tmpPoint) &&
-                            currentNode->contains(tmpPoint) &&
-                            (*crossObject == NULL || (tmpPoint - start).len2() < (*crossPoint - start).len2()))
-                        {
-                            *crossObject = currentNode->objects_[i];
-                            *crossPoint = tmpPoint;
-                        }
-                    }
-                    
-                    if (*crossObject != NULL || stack.empty()) {
-                        break;
-                    }
-                    
-                    currentNode = stack.back().first;
-                    near = far;
-                    far = stack.back().second;
-                    
-                    stack.pop_back();
-                } else {
-                    int axis = currentNode->getSplitAxis();
-                    long double coord = currentNode->getSplitCoord();
-                    
-                    KDNode* farNode  = (far [axis] < coord) ? currentNode->left_ : currentNode->right_;
-                    KDNode* nearNode = (near[axis] < coord) ? currentNode->left_ : currentNode->right_;
-                    
-                    if (nearNode != farNode) {
-                        stack.push_back(std::make_pair(farNode, far));
-                        far = near + ((far - near) * std::fabs(coord - near[axis])) / std::fabs(far[axis] - near[axis]);
-                    }
-                    currentNode = nearNode;
+        // The object the segment ends on must not shadow itself, the margin
+        // covers the error of the end point
+        return accelerator_->occluded(Ray(from, guide / length, 0, length * (1 - REL_EPS) - EPS));
+    }
+    
+    // Finds the closest hit of every lane. The packet walks the tree as one while
+    // its rays agree on the order of children, incoherent packets are traced ray by ray.
+    void tracePacket(RayPacket* packet) const {
+        packet->reset();
+        
+        if (!packet->isCoherent()) {
+            for (int i = 0; i < packet->count; ++i) {
+                Object3D* crossObject;
+                Ray ray(packet->origin(i), packet->direction(i), EPS);
+                if (accelerator_->intersect(&ray, &crossObject)) {
+                    packet->t[i] = ray.tMax;
+                    packet->object[i] = crossObject;
                 }
             }
+            return;
         }
         
-        return *crossObject != NULL;
+        accelerator_->intersect(packet);
     }
     
     void flush() {
@@ -162,10 +534,92 @@ public:
 private:
     Point3D origin_;
     Window window_;
-    KDNode* kdTree;
+    Framebuffer framebuffer_;
+    AccumulationBuffer accumulation_;
+    SamplePattern pattern_;
+    SceneArena arena_;                              // outlives the accelerator, which points into it
+    std::unique_ptr<Accelerator> accelerator_;
+    AcceleratorType acceleratorType_;
+    int threads_;
+    int tileSize_;
+    bool packets_;
+    KDBuilder kdBuilder_;
+    KDBuildParams kdParams_;
+    bool treeBuilt_;
+    LightGrid lightGrid_;
+    Real lightCutoff_;
+    bool lightsIndexed_;       // lightGrid_ is built over the current lights
+    double buildSeconds_, renderSeconds_;
+    size_t rays_;
     
     std::vector<Object3D*> objects_;
     std::vector<Light*> lights_;
+    MaterialTable materials_;
+    
+    // Builds what is missing for a render and clears the image and its samples
+    void prepareRender() {
+        if (!treeBuilt_) {
+            buildTree();
+        }
+        if (!lightsIndexed_) {
+            lightGrid_.build(lights_, lightCutoff_);
+            lightsIndexed_ = true;
+        }
+        framebuffer_.resize(window_.getPixelWidth(), window_.getPixelHeight());
+        accumulation_.reset(framebuffer_.width(), framebuffer_.height());
+    }
+    
+    // Returns the number of rays traced. From here on the tree, the objects and
+    // the lights are only read, every tile writes its own pixels.
+    size_t renderPass(const SamplePass& pass) {
+        std::atomic<size_t> rays(0);
+        TileScheduler scheduler(framebuffer_.width(), framebuffer_.height(), tileSize_, threads_);
+        scheduler.run([this, &pass, &rays](const Tile& tile, int /*worker*/) {
+            rays += renderTile(tile, pass);
+        });
+        return rays;
+    }
+    
+    // Appends the objects, lights and materials of the scene and takes its
+    // camera and window, the objects get the ids of their materials here
+    void takeScene(SceneDescription* scene) {
+        uint32_t first = materials_.append(scene->materials);
+        for (auto object : scene->objects) {
+            object->setMaterialId(first + object->materialId());
+        }
+        
+        origin_ = scene->origin;
+        window_ = Window(scene->leftTop, scene->rightTop, scene->leftBottom);
+        objects_.insert(objects_.end(), scene->objects.begin(), scene->objects.end());
+        lights_.insert(lights_.end(), scene->lights.begin(), scene->lights.end());
+        lightsIndexed_ = false;
+        arena_.adopt(&scene->arena);
+    }
+    
+    Accelerator* createAccelerator() const {
+        switch (acceleratorType_) {
+            case ACCELERATOR_BVH:
+                return new BVH();
+            case ACCELERATOR_BVH4:
+                return new BVH4();
+            default:
+                return new LinearKDTree(kdBuilder_, kdParams_);
+        }
+    }
+    
+    // Cached structures are only reused by the same accelerator, builder and
+    // build parameters
+    uint64_t cacheKey() const {
+        uint32_t kind = (uint32_t) acceleratorType_ << 8 | (uint32_t) kdBuilder_;
+        int limits[] = {KD_MAX_DEPTH, TRAVERSAL_DEPTH, BVHBuilder::BINS, BVHBuilder::LEAF_SIZE,
+                        kdParams_.maxDepth, kdParams_.leafSize};
+        double costs[] = {(double) C_I, (double) C_T, (double) kdParams_.costIntersect,
+                          (double) kdParams_.costTraversal, (double) kdParams_.emptyBonus};
+        
+        uint64_t key = hashBytes(&kind, sizeof(kind));
+        key = hashBytes(limits, sizeof(limits), key);
+        return hashBytes(costs, sizeof(costs), key);
+    }
 };
 
 #endif /* scene_h */
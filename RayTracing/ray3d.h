@@ -0,0 +1,44 @@
+//
+//  ray3d.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef ray3d_h
+#define ray3d_h
+
+#include <limits>
+
+namespace Geometry {
+    // The points origin + direction * t for t in [tMin, tMax], the direction
+    // is a unit vector. Whatever a box or a triangle test needs of the
+    // direction is computed once here. A closest hit search shrinks tMax to
+    // every hit it finds, so the tests that follow only accept nearer ones and
+    // the boxes beyond it are clipped away.
+    struct Ray {
+        Point3D origin;
+        Point3D direction;
+        Point3D inv;            // 1 / direction
+        int sign[3];            // 1 where the direction is negative, picks the near side of a box
+        RayShear shear;
+        Real tMin, tMax;
+        
+        Ray(const Point3D& origin, const Point3D& direction, Real tMin = 0,
+            Real tMax = std::numeric_limits<Real>::infinity());
+            
+        Point3D at(Real t) const {
+            return origin + direction * t;
+        }
+    };
+    
+    Ray::Ray(const Point3D& origin, const Point3D& direction, Real tMin, Real tMax) : origin(origin),
+    direction(direction), inv(1 / direction), shear(direction), tMin(tMin), tMax(tMax) {
+        for (int axis = 0; axis < 3; ++axis) {
+            sign[axis] = direction[axis] < 0;
+        }
+    }
+}
+
+#endif /* ray3d_h */
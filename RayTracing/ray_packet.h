@@ -0,0 +1,158 @@
+//
+//  ray_packet.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef ray_packet_h
+#define ray_packet_h
+
+#include <limits>
+
+#include "geometry.h"
+
+// Lanes per packet, follows the widest vector unit the build targets
+// unless set explicitly with -DRT_PACKET_SIZE=4|8|16
+#ifndef RT_PACKET_SIZE
+#if defined(__AVX512F__)
+#define RT_PACKET_SIZE 16
+#elif defined(__AVX__)
+#define RT_PACKET_SIZE 8
+#else
+#define RT_PACKET_SIZE 4
+#endif
+#endif
+
+class Object3D;
+
+// Structure of arrays of rays with normalized directions. Every per lane loop
+// over a packet is a fixed length loop without branches, so the compiler maps
+// it onto SSE/AVX/AVX-512 (or NEON) registers when Real is float or double.
+struct RayPacket {
+    static const int SIZE = RT_PACKET_SIZE;
+    
+    Geometry::Real o[3][SIZE];       // origins
+    Geometry::Real d[3][SIZE];       // directions
+    Geometry::Real inv[3][SIZE];     // 1 / directions
+    Geometry::Real length[SIZE];     // distance from the origin to the finish point
+    
+    // Geometry::RayShear of the lanes, the axes are taken from the first one
+    int kx, ky, kz;
+    Geometry::Real sx[SIZE], sy[SIZE], sz[SIZE];
+    
+    Geometry::Real t[SIZE];          // distance to the closest hit so far
+    const Object3D* object[SIZE];    // closest object so far, NULL if none
+    
+    int count;                       // used lanes, the rest repeat lane 0
+    
+    RayPacket() : count(0) { }
+    
+    void add(const Geometry::Point3D& start, const Geometry::Point3D& finish) {
+        assert(count < SIZE);
+        
+        Geometry::Point3D guide = finish - start;
+        Geometry::Real len = guide.len();
+        guide /= len;
+        if (count == 0) {
+            Geometry::RayShear shear(guide);
+            kx = shear.kx;
+            ky = shear.ky;
+            kz = shear.kz;
+        }
+        
+        for (int lane = count; lane < (count == 0 ? SIZE : count + 1); ++lane) {
+            for (int axis = 0; axis < 3; ++axis) {
+                o[axis][lane] = start[axis];
+                d[axis][lane] = guide[axis];
+                inv[axis][lane] = 1 / guide[axis];
+            }
+            length[lane] = len;
+            sx[lane] = guide[kx] / guide[kz];
+            sy[lane] = guide[ky] / guide[kz];
+            sz[lane] = 1 / guide[kz];
+        }
+        count++;
+    }
+    
+    void reset() {
+        for (int i = 0; i < SIZE; ++i) {
+            t[i] = std::numeric_limits<Geometry::Real>::infinity();
+            object[i] = NULL;
+        }
+    }
+    
+    Geometry::Point3D origin(int lane) const {
+        return Geometry::Point3D(o[0][lane], o[1][lane], o[2][lane]);
+    }
+    
+    Geometry::Point3D direction(int lane) const {
+        return Geometry::Point3D(d[0][lane], d[1][lane], d[2][lane]);
+    }
+    
+    Geometry::Point3D finish(int lane) const {
+        return origin(lane) + direction(lane) * length[lane];
+    }
+    
+    Geometry::RayShear shear(int lane) const {
+        return Geometry::RayShear(kx, ky, kz, sx[lane], sy[lane], sz[lane]);
+    }
+    
+    Geometry::Point3D hitPoint(int lane) const {
+        return origin(lane) + direction(lane) * t[lane];
+    }
+    
+    // Geometry::triangleEdges over all lanes, read in place. hit is false for
+    // inactive lanes and misses. Float builds redo the lanes with a zero edge
+    // function through the scalar test, it decides them in double.
+    void triangleEdges(const Geometry::Point3D& a, const Geometry::Point3D& b, const Geometry::Point3D& c,
+                       const bool* active, Geometry::Real* U, Geometry::Real* V, Geometry::Real* W, bool* hit) const {
+        const Geometry::Real* ox = o[kx];
+        const Geometry::Real* oy = o[ky];
+        const Geometry::Real* oz = o[kz];
+        const Geometry::Real akx = a[kx], aky = a[ky], akz = a[kz];
+        const Geometry::Real bkx = b[kx], bky = b[ky], bkz = b[kz];
+        const Geometry::Real ckx = c[kx], cky = c[ky], ckz = c[kz];
+        
+        bool zero = false;
+        for (int i = 0; i < SIZE; ++i) {
+            Geometry::Real az = akz - oz[i], bz = bkz - oz[i], cz = ckz - oz[i];
+            Geometry::Real ax = (akx - ox[i]) - sx[i] * az, ay = (aky - oy[i]) - sy[i] * az;
+            Geometry::Real bx = (bkx - ox[i]) - sx[i] * bz, by = (bky - oy[i]) - sy[i] * bz;
+            Geometry::Real cx = (ckx - ox[i]) - sx[i] * cz, cy = (cky - oy[i]) - sy[i] * cz;
+            
+            U[i] = cx * by - cy * bx;
+            V[i] = ax * cy - ay * cx;
+            W[i] = bx * ay - by * ax;
+            
+            bool mixed = ((U[i] < 0) | (V[i] < 0) | (W[i] < 0)) & ((U[i] > 0) | (V[i] > 0) | (W[i] > 0));
+            hit[i] = active[i] & !mixed & (U[i] + V[i] + W[i] != 0);
+            zero |= active[i] & ((U[i] == 0) | (V[i] == 0) | (W[i] == 0));
+        }
+        
+        if (sizeof(Geometry::Real) < sizeof(double) && zero) {
+            for (int i = 0; i < SIZE; ++i) {
+                if (active[i] && (U[i] == 0 || V[i] == 0 || W[i] == 0)) {
+                    hit[i] = Geometry::triangleEdges(origin(i), shear(i), a, b, c, &U[i], &V[i], &W[i]);
+                }
+            }
+        }
+    }
+    
+    // True if all rays go to the same octant, the packet then visits the
+    // children of every KD node in the same order for all of its lanes
+    bool isCoherent() const {
+        for (int axis = 0; axis < 3; ++axis) {
+            bool positive = d[axis][0] > 0;
+            for (int i = 0; i < SIZE; ++i) {
+                if (d[axis][i] == 0 || (d[axis][i] > 0) != positive) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+#endif /* ray_packet_h */
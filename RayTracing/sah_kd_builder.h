@@ -0,0 +1,308 @@
+//
+//  sah_kd_builder.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef sah_kd_builder_h
+#define sah_kd_builder_h
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <vector>
+
+#include "kdTree.h"
+
+// Exact SAH builder after Wald and Havran, "On building fast kd-trees for ray
+// tracing, and on doing that in O(N log N)". The bounds of every object are
+// clipped to the voxel of the node and every side of a clipped box is a split
+// candidate. The candidates of an axis are kept sorted as events and swept in
+// order, so each of them is rated with exact object counts. Events are sorted
+// once at the root, children get theirs by splitting the parent's lists in
+// order, only the objects cut by the plane are sorted again.
+class SAHKDBuilder {
+public:
+    SAHKDBuilder(const KDBuildParams& params = KDBuildParams()) : params_(params) { }
+    
+    // The tree is owned by the caller, its splits are floats as LinearKDTree needs.
+    // Big nodes handle the three axes on parallel threads and the subtrees
+    // below them are built as separate tasks, the tree is the same for any
+    // number of threads.
+    KDNode* build(const std::vector<Object3D*>& objects, int threads = 1) {
+        BoundingBox voxel(objects);
+        
+        std::vector<Reference> refs;
+        for (auto object : objects) {
+            refs.push_back(Reference(object, object->boundingBox()));
+        }
+        
+        std::vector<Event> events[3];
+        parallelSlices(3, axisSlices(refs.size(), threads), [&](int /*slice*/, size_t begin, size_t end) {
+            for (size_t axis = begin; axis < end; ++axis) {
+                for (uint32_t i = 0; i < refs.size(); ++i) {
+                    addEvents(refs[i].bBox, i, (int) axis, &events[axis]);
+                }
+                std::sort(events[axis].begin(), events[axis].end());
+            }
+        });
+        
+        return build(voxel, &refs, events, 0, threads);
+    }
+    
+private:
+    enum EventType {
+        END = 0,        // ends before the planar and starting ones at the same position
+        PLANAR = 1,
+        START = 2
+    };
+    
+    enum Side {
+        BOTH,
+        LEFT,
+        RIGHT
+    };
+    
+    struct Reference {
+        Object3D* object;
+        BoundingBox bBox;       // clipped to the voxel of the node
+        
+        Reference(Object3D* object, const BoundingBox& bBox) : object(object), bBox(bBox) { }
+    };
+    
+    struct Event {
+        Real position;
+        uint32_t ref;
+        int type;
+        
+        bool operator<(const Event& other) const {
+            return position < other.position || (position == other.position && type < other.type);
+        }
+    };
+    
+    struct Split {
+        int axis;
+        float position;
+        bool planarLeft;        // side of the objects lying in the plane
+        Real cost;
+    };
+    
+    KDBuildParams params_;
+    
+    // Threads for the per axis work of a node
+    static int axisSlices(size_t count, int threads) {
+        return count >= KD_PARALLEL_OBJECTS ? std::min(3, std::max(1, threads)) : 1;
+    }
+    
+    static void addEvents(const BoundingBox& bBox, uint32_t ref, int axis, std::vector<Event>* events) {
+        if (bBox.low(axis) == bBox.high(axis)) {
+            Event planar = {bBox.low(axis), ref, PLANAR};
+            events->push_back(planar);
+        } else {
+            Event start = {bBox.low(axis), ref, START};
+            Event end = {bBox.high(axis), ref, END};
+            events->push_back(start);
+            events->push_back(end);
+        }
+    }
+    
+    KDNode* build(const BoundingBox& voxel, std::vector<Reference>* refs, std::vector<Event>* events,
+                  int depth, int threads) {
+        Split split;
+        if ((int) refs->size() <= params_.leafSize || depth >= params_.maxDepth ||
+            !findSplit(voxel, (int) refs->size(), events, threads, &split))
+        {
+            std::vector<Object3D*> objects;
+            for (size_t i = 0; i < refs->size(); ++i) {
+                objects.push_back((*refs)[i].object);
+            }
+            return new KDNode(voxel, objects);
+        }
+        
+        std::pair<BoundingBox, BoundingBox> voxels = voxel.splitAt(split.axis, split.position);
+        std::vector<Reference> leftRefs, rightRefs;
+        std::vector<Event> leftEvents[3], rightEvents[3];
+        splitEvents(split, voxels, threads, refs, events, &leftRefs, leftEvents, &rightRefs, rightEvents);
+        
+        KDNode* node = new KDNode(voxel, std::vector<Object3D*>());
+        node->splitAxis_ = split.axis;
+        
+        if (threads > 1 && rightRefs.size() >= KD_TASK_OBJECTS) {
+            std::future<KDNode*> right = std::async(std::launch::async, [&]() {
+                return build(voxels.second, &rightRefs, rightEvents, depth + 1, threads - threads / 2);
+            });
+            node->left_ = build(voxels.first, &leftRefs, leftEvents, depth + 1, threads / 2);
+            node->right_ = right.get();
+        } else {
+            node->left_ = build(voxels.first, &leftRefs, leftEvents, depth + 1, threads);
+            node->right_ = build(voxels.second, &rightRefs, rightEvents, depth + 1, threads);
+        }
+        return node;
+    }
+    
+    // Sweeps the events of every axis, false if no split is cheaper than a leaf
+    bool findSplit(const BoundingBox& voxel, int count, const std::vector<Event>* events, int threads,
+                   Split* best) const {
+        best->axis = -1;
+        best->cost = params_.costIntersect * count;
+        
+        Real area = voxel.surfaceArea();
+        if (area <= 0) {
+            return false;
+        }
+        
+        // The axes are swept apart and compared in order, as one sweep would
+        Split axisBest[3] = {*best, *best, *best};
+        parallelSlices(3, axisSlices(count, threads), [&](int /*slice*/, size_t begin, size_t end) {
+            for (size_t axis = begin; axis < end; ++axis) {
+                sweep(voxel, area, count, (int) axis, events[axis], &axisBest[axis]);
+            }
+        });
+        
+        for (int axis = 0; axis < 3; ++axis) {
+            if (axisBest[axis].cost < best->cost) {
+                *best = axisBest[axis];
+            }
+        }
+        return best->axis >= 0;
+    }
+    
+    // Rates every plane of one axis, keeps the best one if it beats *best
+    void sweep(const BoundingBox& voxel, Real area, int count, int axis, const std::vector<Event>& axisEvents,
+               Split* best) const {
+        int left = 0, right = count;
+        
+        for (size_t i = 0; i < axisEvents.size(); ) {
+            Real position = axisEvents[i].position;
+            int ending = 0, planar = 0, starting = 0;
+            
+            while (i < axisEvents.size() && axisEvents[i].position == position && axisEvents[i].type == END) {
+                ++ending;
+                ++i;
+            }
+            while (i < axisEvents.size() && axisEvents[i].position == position && axisEvents[i].type == PLANAR) {
+                ++planar;
+                ++i;
+            }
+            while (i < axisEvents.size() && axisEvents[i].position == position && axisEvents[i].type == START) {
+                ++starting;
+                ++i;
+            }
+            
+            right -= planar + ending;
+            
+            // Splits are stored as float, so they are rated where they will end up
+            float plane = (float) position;
+            if (plane > voxel.low(axis) && plane < voxel.high(axis)) {
+                std::pair<BoundingBox, BoundingBox> voxels = voxel.splitAt(axis, plane);
+                Real leftArea = voxels.first.surfaceArea() / area;
+                Real rightArea = voxels.second.surfaceArea() / area;
+                
+                Real costLeft = cost(leftArea, rightArea, left + planar, right);
+                Real costRight = cost(leftArea, rightArea, left, right + planar);
+                
+                if (std::min(costLeft, costRight) < best->cost) {
+                    best->axis = axis;
+                    best->position = plane;
+                    best->planarLeft = costLeft <= costRight;
+                    best->cost = std::min(costLeft, costRight);
+                }
+            }
+            
+            left += starting + planar;
+        }
+    }
+    
+    Real cost(Real leftArea, Real rightArea, int left, int right) const {
+        Real cost = params_.costTraversal + params_.costIntersect * (leftArea * left + rightArea * right);
+        return (left == 0 || right == 0) ? cost * params_.emptyBonus : cost;
+    }
+    
+    Side classify(const BoundingBox& bBox, const Split& split) const {
+        Real low = bBox.low(split.axis), high = bBox.high(split.axis);
+        
+        if (low == split.position && high == split.position) {
+            return split.planarLeft ? LEFT : RIGHT;
+        }
+        if (high <= split.position) {
+            return LEFT;
+        }
+        if (low >= split.position) {
+            return RIGHT;
+        }
+        return BOTH;
+    }
+    
+    // Objects on one side keep their events, which stay sorted. The objects cut
+    // by the plane are clipped to both children, their new events are sorted
+    // and merged in. The lists of the parent are freed on the way.
+    void splitEvents(const Split& split, const std::pair<BoundingBox, BoundingBox>& voxels, int threads,
+                     std::vector<Reference>* refs, std::vector<Event>* events,
+                     std::vector<Reference>* leftRefs, std::vector<Event>* leftEvents,
+                     std::vector<Reference>* rightRefs, std::vector<Event>* rightEvents) const
+    {
+        std::vector<Side> sides(refs->size());
+        std::vector<uint32_t> ids(refs->size());
+        std::vector<Event> leftCut[3], rightCut[3];
+        
+        for (uint32_t i = 0; i < refs->size(); ++i) {
+            const Reference& ref = (*refs)[i];
+            sides[i] = classify(ref.bBox, split);
+            
+            if (sides[i] == LEFT) {
+                ids[i] = (uint32_t) leftRefs->size();
+                leftRefs->push_back(ref);
+            } else if (sides[i] == RIGHT) {
+                ids[i] = (uint32_t) rightRefs->size();
+                rightRefs->push_back(ref);
+            } else {
+                BoundingBox bBox = ref.bBox;
+                if (ref.object->clippedBoundingBox(voxels.first, &bBox)) {
+                    for (int axis = 0; axis < 3; ++axis) {
+                        addEvents(bBox, (uint32_t) leftRefs->size(), axis, &leftCut[axis]);
+                    }
+                    leftRefs->push_back(Reference(ref.object, bBox));
+                }
+                if (ref.object->clippedBoundingBox(voxels.second, &bBox)) {
+                    for (int axis = 0; axis < 3; ++axis) {
+                        addEvents(bBox, (uint32_t) rightRefs->size(), axis, &rightCut[axis]);
+                    }
+                    rightRefs->push_back(Reference(ref.object, bBox));
+                }
+            }
+        }
+        
+        int slices = axisSlices(refs->size(), threads);
+        std::vector<Reference>().swap(*refs);
+        
+        parallelSlices(3, slices, [&](int /*slice*/, size_t begin, size_t end) {
+            for (size_t axis = begin; axis < end; ++axis) {
+                std::vector<Event> left, right;
+                for (size_t i = 0; i < events[axis].size(); ++i) {
+                    Event event = events[axis][i];
+                    if (sides[event.ref] == LEFT) {
+                        event.ref = ids[event.ref];
+                        left.push_back(event);
+                    } else if (sides[event.ref] == RIGHT) {
+                        event.ref = ids[event.ref];
+                        right.push_back(event);
+                    }
+                }
+                std::vector<Event>().swap(events[axis]);
+                
+                std::sort(leftCut[axis].begin(), leftCut[axis].end());
+                std::sort(rightCut[axis].begin(), rightCut[axis].end());
+                
+                leftEvents[axis].resize(left.size() + leftCut[axis].size());
+                std::merge(left.begin(), left.end(), leftCut[axis].begin(), leftCut[axis].end(), leftEvents[axis].begin());
+                rightEvents[axis].resize(right.size() + rightCut[axis].size());
+                std::merge(right.begin(), right.end(), rightCut[axis].begin(), rightCut[axis].end(), rightEvents[axis].begin());
+            }
+        });
+    }
+};
+
+#endif /* sah_kd_builder_h */
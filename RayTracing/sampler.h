@@ -0,0 +1,161 @@
+//
+//  sampler.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef sampler_h
+#define sampler_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "geometry.h"
+
+enum SamplerType {
+    SAMPLER_SOBOL,          // the (0, 2) sequence: van der Corput and the second Sobol dimension
+    SAMPLER_HALTON,         // bases 2 and 3
+    SAMPLER_STRATIFIED,     // jittered 32 x 32 grid, the strata in the order of the Sobol points
+    SAMPLER_BLUE_NOISE,     // best candidate points, every prefix is spread evenly
+    SAMPLER_R2              // additive recurrence of the plastic number
+};
+
+// Sub-pixel positions of the samples of a pixel in [0, 1)^2, computed once
+// when the sampler is chosen. Every pattern is shifted on the torus so that
+// sample 0 is the center of the pixel, which keeps one sample renders on the
+// centers whatever the sampler. The position depends on the sample index
+// only, so every pixel, tile and thread gets the same.
+class SamplePattern {
+public:
+    static const int SIZE = 1024;
+    
+    explicit SamplePattern(SamplerType type = SAMPLER_SOBOL) : type_(type), x_(SIZE), y_(SIZE) {
+        switch (type) {
+            case SAMPLER_HALTON:
+                for (int n = 0; n < SIZE; ++n) {
+                    x_[n] = radicalInverse(n, 2);
+                    y_[n] = radicalInverse(n, 3);
+                }
+                break;
+            case SAMPLER_STRATIFIED:
+                stratify();
+                break;
+            case SAMPLER_BLUE_NOISE:
+                bestCandidates();
+                break;
+            case SAMPLER_R2:
+                for (int n = 0; n < SIZE; ++n) {
+                    x_[n] = fraction(n * 0.7548776662466927);
+                    y_[n] = fraction(n * 0.5698402909980532);
+                }
+                break;
+            default:
+                for (int n = 0; n < SIZE; ++n) {
+                    x_[n] = radicalInverse(n, 2);
+                    y_[n] = sobol(n) / 4294967296.0;
+                }
+                break;
+        }
+        
+        Geometry::Real shiftX = 0.5 - x_[0], shiftY = 0.5 - y_[0];
+        for (int n = 0; n < SIZE; ++n) {
+            x_[n] = fraction(x_[n] + shiftX);
+            y_[n] = fraction(y_[n] + shiftY);
+        }
+        x_[0] = y_[0] = 0.5;     // the shift may round
+    }
+    
+    SamplerType type() const {
+        return type_;
+    }
+    
+    // Sample n of every pixel, the pattern repeats after SIZE samples
+    Geometry::Real x(int n) const {
+        return x_[n % SIZE];
+    }
+    
+    Geometry::Real y(int n) const {
+        return y_[n % SIZE];
+    }
+    
+private:
+    SamplerType type_;
+    std::vector<Geometry::Real> x_, y_;
+    
+    static Geometry::Real fraction(Geometry::Real value) {
+        return value - std::floor(value);
+    }
+    
+    static Geometry::Real radicalInverse(uint32_t n, uint32_t base) {
+        Geometry::Real result = 0, digit = 1.0 / base;
+        for (; n > 0; n /= base, digit /= base) {
+            result += (n % base) * digit;
+        }
+        return result;
+    }
+    
+    // Second dimension of the Sobol sequence as a 32 bit fraction
+    static uint32_t sobol(uint32_t n) {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; n > 0; n >>= 1, v ^= v >> 1) {
+            if (n & 1) {
+                result ^= v;
+            }
+        }
+        return result;
+    }
+    
+    // The first SIZE Sobol points fall one into every cell of the 32 x 32
+    // grid, so they give the order of the strata. Each sample is placed
+    // anywhere in its stratum.
+    void stratify() {
+        const int CELLS = 32;
+        std::minstd_rand random(1);
+        for (int n = 0; n < SIZE; ++n) {
+            int cellX = (int) (radicalInverse(n, 2) * CELLS);
+            int cellY = (int) (sobol(n) / 4294967296.0 * CELLS);
+            x_[n] = (cellX + unit(random)) / CELLS;
+            y_[n] = (cellY + unit(random)) / CELLS;
+        }
+    }
+    
+    // Mitchell's best candidate: every new sample is the candidate farthest
+    // from the samples so far, distances wrap around the pixel
+    void bestCandidates() {
+        const int CANDIDATES = 16;
+        std::minstd_rand random(1);
+        x_[0] = unit(random);
+        y_[0] = unit(random);
+        for (int n = 1; n < SIZE; ++n) {
+            Geometry::Real best = -1;
+            for (int k = 0; k < CANDIDATES; ++k) {
+                Geometry::Real cx = unit(random), cy = unit(random);
+                Geometry::Real nearest = 2;
+                for (int i = 0; i < n; ++i) {
+                    Geometry::Real dx = std::abs(cx - x_[i]), dy = std::abs(cy - y_[i]);
+                    dx = std::min(dx, 1 - dx);
+                    dy = std::min(dy, 1 - dy);
+                    nearest = std::min(nearest, dx * dx + dy * dy);
+                }
+                if (nearest > best) {
+                    best = nearest;
+                    x_[n] = cx;
+                    y_[n] = cy;
+                }
+            }
+        }
+    }
+    
+    // minstd_rand is fully specified, the patterns are the same everywhere
+    static Geometry::Real unit(std::minstd_rand& random) {
+        return (Geometry::Real) (random() - std::minstd_rand::min()) /
+               (std::minstd_rand::max() - std::minstd_rand::min() + 1);
+    }
+};
+
+#endif /* sampler_h */
@@ -0,0 +1,145 @@
+//
+//  scene_arena.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef scene_arena_h
+#define scene_arena_h
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Owner of everything a scene allocates: objects, lights and meshes. Every
+// type gets its own pool of blocks, so the spheres of a scene lie next to each
+// other, then its triangles and so on. Nothing is freed one by one, reset()
+// destroys all objects of the arena in one go.
+class SceneArena {
+public:
+    SceneArena() { }
+    
+    SceneArena(const SceneArena&) = delete;
+    SceneArena& operator =(const SceneArena&) = delete;
+    
+    ~SceneArena() {
+        reset();
+    }
+    
+    // Constructs a T in the pool of its type, it lives until reset()
+    template <class T, class... Args>
+    T* create(Args&&... args) {
+        return pool<T>()->create(std::forward<Args>(args)...);
+    }
+    
+    // Takes over the objects of the other arena, which is left empty
+    void adopt(SceneArena* other) {
+        for (auto& entry : other->pools_) {
+            auto found = pools_.find(entry.first);
+            if (found == pools_.end()) {
+                pools_.insert(std::make_pair(entry.first, std::move(entry.second)));
+            } else {
+                found->second->adopt(entry.second.get());
+            }
+        }
+        other->pools_.clear();
+    }
+    
+    // Destroys every object of the arena and releases its memory
+    void reset() {
+        pools_.clear();
+    }
+    
+    size_t memoryUsage() const {
+        size_t bytes = 0;
+        for (auto& entry : pools_) {
+            bytes += entry.second->memoryUsage();
+        }
+        return bytes;
+    }
+    
+private:
+    class PoolBase {
+    public:
+        virtual ~PoolBase() { }
+        virtual void adopt(PoolBase* other) = 0;
+        virtual size_t memoryUsage() const = 0;
+    };
+    
+    // Blocks of about BLOCK_BYTES, filled in order. The objects are destroyed
+    // in the order they were created.
+    template <class T>
+    class Pool : public PoolBase {
+    public:
+        static const size_t BLOCK_BYTES = 64 * 1024;
+        
+        virtual ~Pool() {
+            for (auto& block : blocks_) {
+                for (size_t i = 0; i < block.count; ++i) {
+                    block.data[i].~T();
+                }
+                ::operator delete(block.data);
+            }
+        }
+        
+        template <class... Args>
+        T* create(Args&&... args) {
+            if (blocks_.empty() || blocks_.back().count == blocks_.back().capacity) {
+                Block block;
+                block.capacity = std::max(BLOCK_BYTES / sizeof(T), (size_t) 1);
+                block.data = static_cast<T*>(::operator new(block.capacity * sizeof(T)));
+                block.count = 0;
+                blocks_.push_back(block);
+            }
+            
+            Block& block = blocks_.back();
+            T* object = new (block.data + block.count) T(std::forward<Args>(args)...);
+            ++block.count;
+            return object;
+        }
+        
+        // The partly filled block of this pool stays the last one
+        virtual void adopt(PoolBase* other) {
+            Pool* pool = static_cast<Pool*>(other);
+            blocks_.insert(blocks_.empty() ? blocks_.end() : blocks_.end() - 1, pool->blocks_.begin(),
+                           pool->blocks_.end());
+            pool->blocks_.clear();
+        }
+        
+        virtual size_t memoryUsage() const {
+            size_t bytes = blocks_.capacity() * sizeof(Block);
+            for (auto& block : blocks_) {
+                bytes += block.capacity * sizeof(T);
+            }
+            return bytes;
+        }
+        
+    private:
+        struct Block {
+            T* data;
+            size_t count, capacity;
+        };
+        
+        std::vector<Block> blocks_;
+    };
+    
+    std::unordered_map<std::type_index, std::unique_ptr<PoolBase>> pools_;
+    
+    template <class T>
+    Pool<T>* pool() {
+        std::unique_ptr<PoolBase>& pool = pools_[std::type_index(typeid(T))];
+        if (!pool) {
+            pool.reset(new Pool<T>());
+        }
+        return static_cast<Pool<T>*>(pool.get());
+    }
+};
+
+#endif /* scene_arena_h */
@@ -0,0 +1,323 @@
+//
+//  scene_cache.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef scene_cache_h
+#define scene_cache_h
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "accelerator.h"
+#include "scene_parser.h"
+
+// 64 bit FNV-1a, pass the previous result to hash several pieces as one
+inline uint64_t hashBytes(const void* data, size_t bytes, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char* begin = (const unsigned char*) data;
+    for (size_t i = 0; i < bytes; ++i) {
+        hash = (hash ^ begin[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Hash of everything left in the stream, the key of a cached scene
+inline uint64_t hashStream(std::istream& stream) {
+    uint64_t hash = hashBytes(NULL, 0);
+    std::vector<char> block(1 << 20);
+    
+    while (stream) {
+        stream.read(block.data(), block.size());
+        hash = hashBytes(block.data(), (size_t) stream.gcount(), hash);
+    }
+    return hash;
+}
+
+// Records of the cache file. Everything is stored the way it is in memory,
+// with Real as compiled, and refers to other records by index. Materials are
+// the MaterialEntry records of the table.
+struct SceneCacheSection {
+    uint64_t offset;            // from the start of the file
+    uint64_t count;
+};
+
+struct SceneCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t realBytes;
+    uint32_t reserved;
+    uint64_t key;               // accelerator, builder and parameters, see RayTracer::cacheKey()
+    uint64_t sourceHash;
+    Geometry::Point3D origin, leftTop, rightTop, leftBottom;
+    Geometry::Point3D low, high;    // AcceleratorData::bBox
+    SceneCacheSection materials, objects, points, lights, nodes, indices;
+};
+
+struct SceneCacheObject {
+    enum Type { SPHERE, TRIANGLE, QUADRANGLE, POLYGON };
+    
+    uint32_t type;
+    uint32_t material;
+    uint32_t firstPoint;        // polygons are followed by their orientation
+    uint32_t pointCount;
+    Geometry::Real radius;
+};
+
+struct SceneCacheLight {
+    Geometry::Point3D position;
+    Geometry::Vec3 ambient, diffuse, specular, distance;
+};
+
+// Versioned binary copy of a parsed scene together with its built
+// acceleration structure. The file is a header and flat arrays at aligned
+// offsets, it's mapped into memory and read without any parsing.
+class SceneCache {
+public:
+    // Bumped whenever the layout or a builder changes, the build parameters
+    // are covered by the key
+    static const uint32_t VERSION = 4;
+    static const uint64_t ALIGNMENT = 64;
+    
+    // The accelerator must be built over the objects of the scene. The file
+    // is written next to the path and renamed, readers never see half of it.
+    static bool write(const std::string& path, uint64_t sourceHash, uint64_t key,
+                      const SceneDescription& scene, const Accelerator& accelerator) {
+        std::vector<SceneCacheObject> objects;
+        std::vector<Geometry::Point3D> points;
+        std::vector<SceneCacheLight> lights;
+        
+        for (auto object : scene.objects) {
+            SceneCacheObject record;
+            memset((void*) &record, 0, sizeof(record));
+            record.material = object->materialId();
+            record.firstPoint = (uint32_t) points.size();
+            
+            if (const Sphere* sphere = dynamic_cast<const Sphere*>(object)) {
+                record.type = SceneCacheObject::SPHERE;
+                record.pointCount = 1;
+                record.radius = sphere->radius();
+                points.push_back(sphere->center());
+            } else if (const Polygon* polygon = dynamic_cast<const Polygon*>(object)) {
+                if (dynamic_cast<const Triangle*>(object) != NULL) {
+                    record.type = SceneCacheObject::TRIANGLE;
+                } else if (dynamic_cast<const Quadrangle*>(object) != NULL) {
+                    record.type = SceneCacheObject::QUADRANGLE;
+                } else {
+                    record.type = SceneCacheObject::POLYGON;
+                }
+                record.pointCount = (uint32_t) polygon->polygon().cnt;
+                points.insert(points.end(), polygon->polygon().points, polygon->polygon().points + record.pointCount);
+                points.push_back(polygon->orientation());
+            } else {
+                printf("Could not cache the scene: unknown object type\n");
+                return false;
+            }
+            objects.push_back(record);
+        }
+        
+        for (auto light : scene.lights) {
+            SceneCacheLight record;
+            memset((void*) &record, 0, sizeof(record));
+            record.position = light->position();
+            record.ambient = light->params().ambient();
+            record.diffuse = light->params().diffuse();
+            record.specular = light->params().specular();
+            record.distance = light->params().distance();
+            lights.push_back(record);
+        }
+        
+        AcceleratorData data = accelerator.data();
+        SceneCacheHeader header;
+        memset((void*) &header, 0, sizeof(header));
+        memcpy(header.magic, "RTSC", 4);
+        header.version = VERSION;
+        header.realBytes = sizeof(Geometry::Real);
+        header.key = key;
+        header.sourceHash = sourceHash;
+        header.origin = scene.origin;
+        header.leftTop = scene.leftTop;
+        header.rightTop = scene.rightTop;
+        header.leftBottom = scene.leftBottom;
+        header.low = data.bBox.low();
+        header.high = data.bBox.high();
+        
+        uint64_t offset = align(sizeof(header));
+        header.materials = section(&offset, scene.materials.size(), sizeof(MaterialEntry));
+        header.objects = section(&offset, objects.size(), sizeof(SceneCacheObject));
+        header.points = section(&offset, points.size(), sizeof(Geometry::Point3D));
+        header.lights = section(&offset, lights.size(), sizeof(SceneCacheLight));
+        header.nodes = section(&offset, data.nodeBytes, 1);
+        header.indices = section(&offset, data.indexCount, sizeof(uint32_t));
+        
+        std::string temporary = path + ".tmp";
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        writeSection(file, &header, sizeof(header));
+        writeSection(file, scene.materials.data(), scene.materials.size() * sizeof(MaterialEntry));
+        writeSection(file, objects.data(), objects.size() * sizeof(SceneCacheObject));
+        writeSection(file, points.data(), points.size() * sizeof(Geometry::Point3D));
+        writeSection(file, lights.data(), lights.size() * sizeof(SceneCacheLight));
+        writeSection(file, data.nodes, data.nodeBytes);
+        writeSection(file, data.indices, data.indexCount * sizeof(uint32_t));
+        file.close();
+        
+        if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            printf("Could not write the scene cache %s\n", path.c_str());
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+    // Fills the empty scene and loads the accelerator from the file, false if
+    // the file is missing, broken or was written for another source or key
+    static bool read(const std::string& path, uint64_t sourceHash, uint64_t key,
+                     SceneDescription* scene, Accelerator* accelerator) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        
+        struct stat info;
+        void* mapped = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(SceneCacheHeader)) {
+            mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        
+        bool loaded = read((const char*) mapped, info.st_size, sourceHash, key, scene, accelerator);
+        munmap(mapped, info.st_size);
+        return loaded;
+    }
+    
+private:
+    static uint64_t align(uint64_t offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+    
+    static SceneCacheSection section(uint64_t* offset, size_t count, size_t recordBytes) {
+        SceneCacheSection section;
+        section.offset = *offset;
+        section.count = count;
+        *offset = align(*offset + count * recordBytes);
+        return section;
+    }
+    
+    static void writeSection(std::ofstream& file, const void* data, size_t bytes) {
+        static const char ZEROS[ALIGNMENT] = {0};
+        file.write((const char*) data, bytes);
+        file.write(ZEROS, align(bytes) - bytes);
+    }
+    
+    // Start of a section, NULL if it doesn't lie within the file
+    template<class Record>
+    static const Record* records(const char* file, size_t size, const SceneCacheSection& section,
+                                 size_t recordBytes = sizeof(Record)) {
+        if (section.offset % ALIGNMENT != 0 || section.offset > size ||
+            section.count > (size - section.offset) / recordBytes) {
+            return NULL;
+        }
+        return (const Record*) (file + section.offset);
+    }
+    
+    static bool read(const char* file, size_t size, uint64_t sourceHash, uint64_t key,
+                     SceneDescription* scene, Accelerator* accelerator) {
+        const SceneCacheHeader& header = *(const SceneCacheHeader*) file;
+        if (memcmp(header.magic, "RTSC", 4) != 0 || header.version != VERSION ||
+            header.realBytes != sizeof(Geometry::Real) || header.key != key || header.sourceHash != sourceHash) {
+            return false;
+        }
+        
+        const MaterialEntry* materials = records<MaterialEntry>(file, size, header.materials);
+        const SceneCacheObject* objects = records<SceneCacheObject>(file, size, header.objects);
+        const Geometry::Point3D* points = records<Geometry::Point3D>(file, size, header.points);
+        const SceneCacheLight* lights = records<SceneCacheLight>(file, size, header.lights);
+        const char* nodes = records<char>(file, size, header.nodes);
+        const uint32_t* indices = records<uint32_t>(file, size, header.indices);
+        if (materials == NULL || objects == NULL || points == NULL || lights == NULL || nodes == NULL ||
+            indices == NULL) {
+            return false;
+        }
+        
+        for (uint64_t i = 0; i < header.materials.count; ++i) {
+            scene->materials.add(materials[i]);
+        }
+        
+        scene->objects.reserve(header.objects.count);
+        for (uint64_t i = 0; i < header.objects.count; ++i) {
+            Object3D* object = createObject(objects[i], header.materials.count, points, header.points.count,
+                                            &scene->arena);
+            if (object == NULL) {
+                scene->clear();
+                return false;
+            }
+            scene->objects.push_back(object);
+        }
+        
+        for (uint64_t i = 0; i < header.lights.count; ++i) {
+            const SceneCacheLight& light = lights[i];
+            scene->lights.push_back(scene->arena.create<Light>(light.position,
+                                                               LightParams(light.ambient, light.diffuse, light.specular,
+                                                                           light.distance)));
+        }
+        
+        scene->origin = header.origin;
+        scene->leftTop = header.leftTop;
+        scene->rightTop = header.rightTop;
+        scene->leftBottom = header.leftBottom;
+        
+        AcceleratorData data;
+        data.nodes = nodes;
+        data.nodeBytes = header.nodes.count;
+        data.indices = indices;
+        data.indexCount = header.indices.count;
+        data.bBox = BoundingBox(header.low, header.high);
+        if (!accelerator->load(data, scene->objects)) {
+            scene->clear();
+            return false;
+        }
+        return true;
+    }
+    
+    static Object3D* createObject(const SceneCacheObject& record, uint64_t materialCount,
+                                  const Geometry::Point3D* points, uint64_t pointCount, SceneArena* arena) {
+        uint64_t used = (uint64_t) record.pointCount + (record.type == SceneCacheObject::SPHERE ? 0 : 1);
+        if (record.material >= materialCount || record.firstPoint > pointCount ||
+            used > pointCount - record.firstPoint) {
+            return NULL;
+        }
+        uint32_t material = record.material;
+        
+        // The constructors copy the points, they aren't changed through the pointer
+        Geometry::Point3D* first = const_cast<Geometry::Point3D*>(points + record.firstPoint);
+        switch (record.type) {
+            case SceneCacheObject::SPHERE:
+                return record.pointCount == 1 ? arena->create<Sphere>(first[0], record.radius, material) : NULL;
+            case SceneCacheObject::TRIANGLE:
+                return record.pointCount == 3 ? arena->create<Triangle>(first, material) : NULL;
+            case SceneCacheObject::QUADRANGLE:
+                return record.pointCount == 4 ? arena->create<Quadrangle>(first, material) : NULL;
+            case SceneCacheObject::POLYGON:
+                return record.pointCount >= 3 ?
+                    arena->create<Polygon>(first, (int) record.pointCount, material, first[record.pointCount]) : NULL;
+            default:
+                return NULL;
+        }
+    }
+};
+
+#endif /* scene_cache_h */
@@ -0,0 +1,245 @@
+//
+//  scene_parser.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef scene_parser_h
+#define scene_parser_h
+
+#include <cstdio>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "geometry.h"
+#include "objects.h"
+#include "scene_arena.h"
+#include "text_reader.h"
+
+// Everything a .rt file describes, the objects and lights live in the arena
+// until whoever takes the scene adopts it. Material ids of the objects index
+// the materials of the scene.
+struct SceneDescription {
+    Geometry::Point3D origin;
+    Geometry::Point3D leftTop, rightTop, leftBottom;
+    std::vector<Object3D*> objects;
+    std::vector<Light*> lights;
+    MaterialTable materials;
+    SceneArena arena;
+    
+    // Destroys the objects and lights
+    void clear() {
+        objects.clear();
+        lights.clear();
+        materials.clear();
+        arena.reset();
+    }
+};
+
+// Reads .rt scenes in one pass over the stream. Every line is a statement,
+// '#' starts a comment, numbers are decimal and points are three numbers:
+//
+//   camera POINT
+//   window LEFT_TOP RIGHT_TOP LEFT_BOTTOM
+//   material NAME AMBIENT DIFFUSE SPECULAR [SHINE [EMIT]]
+//   sphere CENTER RADIUS MATERIAL
+//   triangle POINT POINT POINT MATERIAL
+//   quadrangle POINT POINT POINT POINT MATERIAL
+//   polygon COUNT POINT... MATERIAL
+//   light POSITION AMBIENT DIFFUSE SPECULAR [DISTANCE]
+//
+// Colors are three numbers too. Materials are named and must be defined
+// before they're used. Light intensities are single numbers and DISTANCE holds
+// the constant, linear and quadratic attenuation, 0 0 1 by default. A scene
+// needs exactly one camera and one window.
+class SceneParser {
+public:
+    // Longest polygon, a wrong COUNT fails here instead of in the allocation
+    static const long MAX_POLYGON_POINTS = 1 << 16;
+    
+    // On failure the scene is left empty and error() tells what went wrong
+    bool parse(std::istream& stream, SceneDescription* scene) {
+        TextReader reader(stream);
+        materials_.clear();
+        error_.clear();
+        bool camera = false, window = false;
+        
+        while (reader.nextLine()) {
+            if (!parseStatement(reader, scene, &camera, &window)) {
+                scene->clear();
+                return false;
+            }
+        }
+        
+        if (!stream.eof()) {
+            error_ = "could not read the stream";
+        } else if (!camera) {
+            error_ = "the scene has no camera";
+        } else if (!window) {
+            error_ = "the scene has no window";
+        }
+        if (!error_.empty()) {
+            scene->clear();
+            return false;
+        }
+        return true;
+    }
+    
+    // Line number and description of the last failure
+    const std::string& error() const {
+        return error_;
+    }
+    
+private:
+    std::unordered_map<std::string, uint32_t> materials_;     // ids in the table of the scene
+    std::string name_;                          // reused for lookups, so they don't allocate
+    std::vector<Geometry::Point3D> points_;     // reused by polygons
+    std::string error_;
+    
+    bool parseStatement(TextReader& reader, SceneDescription* scene, bool* camera, bool* window) {
+        Token command = {NULL, 0};
+        reader.token(&command);
+        
+        if (command == "camera") {
+            if (*camera) {
+                return fail(reader, "the camera is already set");
+            }
+            if (!reader.number(&scene->origin)) {
+                return fail(reader, "camera expects a point");
+            }
+            *camera = true;
+        } else if (command == "window") {
+            if (*window) {
+                return fail(reader, "the window is already set");
+            }
+            if (!reader.number(&scene->leftTop) || !reader.number(&scene->rightTop) ||
+                !reader.number(&scene->leftBottom)) {
+                return fail(reader, "window expects three points");
+            }
+            *window = true;
+        } else if (command == "material") {
+            if (!parseMaterial(reader, scene)) {
+                return false;
+            }
+        } else if (command == "sphere") {
+            Geometry::Point3D center;
+            Geometry::Real radius;
+            uint32_t material;
+            if (!reader.number(&center) || !reader.number(&radius) || radius <= 0) {
+                return fail(reader, "sphere expects a center and a positive radius");
+            }
+            if (!findMaterial(reader, &material)) {
+                return false;
+            }
+            scene->objects.push_back(scene->arena.create<Sphere>(center, radius, material));
+        } else if (command == "triangle" || command == "quadrangle" || command == "polygon") {
+            long count = command == "triangle" ? 3 : 4;
+            if (command == "polygon" && (!reader.integer(&count) || count < 3 || count > MAX_POLYGON_POINTS)) {
+                return fail(reader, "polygon expects the number of its points, from 3 to 65536");
+            }
+            
+            points_.resize(count);
+            for (long i = 0; i < count; ++i) {
+                if (!reader.number(&points_[i])) {
+                    return fail(reader, "not enough points");
+                }
+            }
+            uint32_t material;
+            if (!findMaterial(reader, &material)) {
+                return false;
+            }
+            
+            if (count == 3) {
+                scene->objects.push_back(scene->arena.create<Triangle>(points_.data(), material));
+            } else if (count == 4) {
+                scene->objects.push_back(scene->arena.create<Quadrangle>(points_.data(), material));
+            } else {
+                scene->objects.push_back(scene->arena.create<Polygon>(points_.data(), (int) count, material));
+            }
+        } else if (command == "light") {
+            Geometry::Point3D position;
+            Geometry::Real ambient, diffuse, specular;
+            Geometry::Vec3 distance(0, 0, 1);
+            if (!reader.number(&position) || !reader.number(&ambient) || !reader.number(&diffuse) ||
+                !reader.number(&specular)) {
+                return fail(reader, "light expects a position and three intensities");
+            }
+            if (!reader.atEnd() && !reader.number(&distance)) {
+                return fail(reader, "light attenuation expects three numbers");
+            }
+            scene->lights.push_back(scene->arena.create<Light>(position,
+                                                              LightParams(ambient, diffuse, specular, distance)));
+        } else {
+            return fail(reader, "unknown statement", &command);
+        }
+        
+        Token extra;
+        if (reader.token(&extra)) {
+            return fail(reader, "unexpected", &extra);
+        }
+        return true;
+    }
+    
+    bool parseMaterial(TextReader& reader, SceneDescription* scene) {
+        Token name;
+        Geometry::Vec3 ambient, diffuse, specular;
+        Geometry::Real shine = 1;
+        Geometry::Vec3 emit(0, 0, 0);
+        
+        if (!reader.token(&name)) {
+            return fail(reader, "material expects a name");
+        }
+        name_.assign(name.begin, name.length);
+        if (materials_.count(name_) > 0) {
+            return fail(reader, "duplicate material", &name);
+        }
+        
+        if (!reader.number(&ambient) || !reader.number(&diffuse) || !reader.number(&specular)) {
+            return fail(reader, "material expects ambient, diffuse and specular colors");
+        }
+        if (!reader.atEnd() && !reader.number(&shine)) {
+            return fail(reader, "material shine must be a number");
+        }
+        if (!reader.atEnd() && !reader.number(&emit)) {
+            return fail(reader, "material emission expects a color");
+        }
+        
+        uint32_t id = scene->materials.add(Material(ambient, diffuse, specular, shine, emit));
+        materials_.insert(std::make_pair(name_, id));
+        return true;
+    }
+    
+    bool findMaterial(TextReader& reader, uint32_t* material) {
+        Token name;
+        if (!reader.token(&name)) {
+            return fail(reader, "expected a material name");
+        }
+        
+        name_.assign(name.begin, name.length);
+        auto found = materials_.find(name_);
+        if (found == materials_.end()) {
+            return fail(reader, "unknown material", &name);
+        }
+        *material = found->second;
+        return true;
+    }
+    
+    bool fail(const TextReader& reader, const char* message, const Token* token = NULL) {
+        char line[64];
+        snprintf(line, sizeof(line), "line %d: ", reader.line());
+        error_ = line;
+        error_ += message;
+        if (token != NULL) {
+            error_ += " '";
+            error_.append(token->begin, token->length);
+            error_ += "'";
+        }
+        return false;
+    }
+};
+
+#endif /* scene_parser_h */
@@ -0,0 +1,71 @@
+//
+//  shading_batch.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef shading_batch_h
+#define shading_batch_h
+
+#include "geometry.h"
+#include "object3d.h"
+
+// Structure of arrays of hits waiting for shading. Whatever a hit needs from
+// its object is computed once in add(): the unit normal, the unit vector to
+// the viewer and the material. The lights then run plain loops over the
+// arrays, see Light::illuminate().
+struct ShadingBatch {
+    static const int CAPACITY = 64;
+    
+    Geometry::Real point[3][CAPACITY];
+    Geometry::Real normal[3][CAPACITY];
+    Geometry::Real view[3][CAPACITY];
+    Geometry::Real ambient[3][CAPACITY];
+    Geometry::Real diffuse[3][CAPACITY];
+    Geometry::Real specular[3][CAPACITY];
+    Geometry::Real shine[CAPACITY];
+    Geometry::Real color[3][CAPACITY];      // the base intensity, the lights add to it
+    int target[CAPACITY];                   // where the caller wants the color of the hit
+    
+    int count;
+    
+    ShadingBatch() : count(0) { }
+    
+    bool full() const {
+        return count == CAPACITY;
+    }
+    
+    void add(const Object3D& object, const MaterialEntry& material, const Geometry::Point3D& hit,
+             const Geometry::Point3D& viewer, Geometry::Vec3 global, int where) {
+        assert(count < CAPACITY);
+        
+        Geometry::Point3D n = object.normalAt(hit).normalize();
+        Geometry::Point3D v = (viewer - hit).normalize();
+        Geometry::Vec3 base = material.baseIntencity(global);
+        Geometry::Vec3 a = material.ambient(), d = material.diffuse(), s = material.specular();
+        for (int axis = 0; axis < 3; ++axis) {
+            point[axis][count] = hit[axis];
+            normal[axis][count] = n[axis];
+            view[axis][count] = v[axis];
+            ambient[axis][count] = a.vec[axis];
+            diffuse[axis][count] = d.vec[axis];
+            specular[axis][count] = s.vec[axis];
+            color[axis][count] = base.vec[axis];
+        }
+        shine[count] = material.shine();
+        target[count] = where;
+        count++;
+    }
+    
+    Geometry::Point3D hitPoint(int i) const {
+        return Geometry::Point3D(point[0][i], point[1][i], point[2][i]);
+    }
+    
+    void clear() {
+        count = 0;
+    }
+};
+
+#endif /* shading_batch_h */
@@ -12,13 +12,13 @@
 namespace Geometry {
     struct Sphere3D {
         Point3D center;
-        long double r;
+        Real r;
         
         Sphere3D() { }
-        Sphere3D(Point3D center, long double r);
+        Sphere3D(Point3D center, Real r);
     };
     
-    Sphere3D::Sphere3D(Point3D center, long double r) : center(center), r(r) { }
+    Sphere3D::Sphere3D(Point3D center, Real r) : center(center), r(r) { }
 }
 
 #endif /* sphere3d_h */
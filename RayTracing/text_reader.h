@@ -0,0 +1,264 @@
+//
+//  text_reader.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef text_reader_h
+#define text_reader_h
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <vector>
+
+#include "geometry.h"
+
+// Piece of the current line, only valid until the next call to nextLine()
+struct Token {
+    const char* begin;
+    size_t length;
+    
+    bool operator ==(const char* word) const {
+        return strlen(word) == length && memcmp(begin, word, length) == 0;
+    }
+    
+    bool operator !=(const char* word) const {
+        return !(*this == word);
+    }
+};
+
+// Line oriented tokenizer for the text formats. The stream is read in big
+// blocks, tokens point into the block and numbers are parsed in place, so
+// nothing is allocated per line or token. '#' comments out the rest of a line.
+class TextReader {
+public:
+    TextReader(std::istream& stream, size_t blockSize = 1 << 20) : stream_(stream),
+        buffer_(blockSize + 1), begin_(0), end_(0), cursor_(0), lineEnd_(0), line_(0), nextLine_(1) { }
+        
+    // Moves to the next line with a token on it, false at the end of the stream
+    bool nextLine() {
+        while (readLine()) {
+            skipSpaces();
+            if (cursor_ < lineEnd_) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Number of the current line, counted from 1
+    int line() const {
+        return line_;
+    }
+    
+    // No tokens left on the current line
+    bool atEnd() {
+        skipSpaces();
+        return cursor_ >= lineEnd_;
+    }
+    
+    bool token(Token* token) {
+        skipSpaces();
+        if (cursor_ >= lineEnd_) {
+            return false;
+        }
+        
+        token->begin = &buffer_[cursor_];
+        while (cursor_ < lineEnd_ && !isSpace(buffer_[cursor_])) {
+            ++cursor_;
+        }
+        token->length = &buffer_[cursor_] - token->begin;
+        return true;
+    }
+    
+    bool number(Geometry::Real* value) {
+        Token word;
+        return token(&word) && parseNumber(word, value);
+    }
+    
+    bool number(Geometry::Point3D* point) {
+        return number(&point->x) && number(&point->y) && number(&point->z);
+    }
+    
+    bool number(Geometry::Vec3* vec) {
+        return number(&vec->vec[0]) && number(&vec->vec[1]) && number(&vec->vec[2]);
+    }
+    
+    bool integer(long* value) {
+        Token word;
+        return token(&word) && parseInteger(word.begin, word.begin + word.length, value);
+    }
+    
+    // Whole of [begin, end) as a decimal integer, for tokens with parts like the faces of OBJ files.
+    // False on anything else and on values out of the range of long.
+    static bool parseInteger(const char* begin, const char* end, long* value) {
+        const char* p = begin;
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            ++p;
+        }
+        if (p == end) {
+            return false;
+        }
+        
+        long result = 0;
+        for (; p < end; ++p) {
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            int digit = *p - '0';
+            if (result > (LONG_MAX - digit) / 10) {
+                return false;
+            }
+            result = result * 10 + digit;
+        }
+        *value = negative ? -result : result;
+        return true;
+    }
+    
+private:
+    std::istream& stream_;
+    std::vector<char> buffer_;      // one spare byte for the terminating zero of the last line
+    size_t begin_, end_;            // unread bytes of the buffer
+    size_t cursor_, lineEnd_;       // current line
+    int line_, nextLine_;
+    
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0';
+    }
+    
+    void skipSpaces() {
+        while (cursor_ < lineEnd_ && isSpace(buffer_[cursor_])) {
+            ++cursor_;
+        }
+    }
+    
+    // Finds the next line in the buffer, refilling it as needed. The line ends
+    // with a zero in place of its newline, so strtold can't run past it.
+    bool readLine() {
+        size_t scanned = begin_;
+        while (true) {
+            char* newline = (char*) memchr(&buffer_[scanned], '\n', end_ - scanned);
+            if (newline != NULL) {
+                lineEnd_ = newline - &buffer_[0];
+                break;
+            }
+            
+            if (!stream_.good()) {
+                if (begin_ == end_) {
+                    return false;
+                }
+                lineEnd_ = end_;    // the last line has no newline
+                break;
+            }
+            
+            // Keep the partial line at the front, grow the buffer for lines longer than it
+            scanned = end_ - begin_;
+            memmove(&buffer_[0], &buffer_[begin_], end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+            if (end_ + 1 >= buffer_.size()) {
+                buffer_.resize(buffer_.size() * 2);
+            }
+            
+            stream_.read(&buffer_[end_], buffer_.size() - 1 - end_);
+            end_ += stream_.gcount();
+        }
+        
+        buffer_[lineEnd_] = '\0';
+        cursor_ = begin_;
+        begin_ = std::min(lineEnd_ + 1, end_);
+        line_ = nextLine_++;
+        
+        char* comment = (char*) memchr(&buffer_[cursor_], '#', lineEnd_ - cursor_);
+        if (comment != NULL) {
+            lineEnd_ = comment - &buffer_[0];
+        }
+        return true;
+    }
+    
+    // Decimal numbers with up to 18 significant digits are assembled from an
+    // integer mantissa and an exact power of ten, longer ones go to strtold.
+    // False on values out of the range of Real.
+    static bool parseNumber(const Token& word, Geometry::Real* value) {
+        static const long double POWERS[] = {
+            1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L,
+            1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+        };
+        
+        const char* p = word.begin;
+        const char* end = word.begin + word.length;
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            ++p;
+        }
+        
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+            any = true;
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+                any = true;
+            }
+        }
+        if (!any) {
+            return false;
+        }
+        
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negativeExponent = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+')) {
+                ++p;
+            }
+            if (p == end) {
+                return false;
+            }
+            int power = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+                power = std::min(power * 10 + (*p - '0'), 100000);
+            }
+            exponent += negativeExponent ? -power : power;
+        }
+        if (p != end) {
+            return false;
+        }
+        
+        long double result;
+        if (digits > 18 || exponent < -27 || exponent > 27) {
+            char* stop;
+            result = strtold(word.begin, &stop);
+            if (stop != end) {
+                return false;
+            }
+        } else {
+            result = exponent < 0 ? mantissa / POWERS[-exponent] : mantissa * POWERS[exponent];
+            result = negative ? -result : result;
+        }
+        
+        // strtold overflows to infinity, and a float can't hold what a long double can
+        if (!(std::fabs(result) <= std::numeric_limits<Geometry::Real>::max())) {
+            return false;
+        }
+        *value = (Geometry::Real) result;
+        return true;
+    }
+};
+
+#endif /* text_reader_h */
@@ -0,0 +1,125 @@
+//
+//  tile_scheduler.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef tile_scheduler_h
+#define tile_scheduler_h
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Tile {
+    int x0, y0;     // inclusive
+    int x1, y1;     // exclusive
+    
+    Tile(int x0, int y0, int x1, int y1) : x0(x0), y0(y0), x1(x1), y1(y1) { }
+};
+
+// Cuts the image into tiles and runs them on a pool of threads.
+// Every worker starts with its own contiguous run of tiles and, once it is
+// done, steals from the back of the other workers' queues, so a few
+// expensive tiles don't leave the rest of the pool idle.
+class TileScheduler {
+public:
+    TileScheduler(int width, int height, int tileSize, int threads) : threads_(std::max(1, threads)) {
+        tileSize = std::max(1, tileSize);
+        for (int y = 0; y < height; y += tileSize) {
+            for (int x = 0; x < width; x += tileSize) {
+                tiles_.push_back(Tile(x, y, std::min(x + tileSize, width), std::min(y + tileSize, height)));
+            }
+        }
+        threads_ = std::min(threads_, std::max(1, (int) tiles_.size()));
+    }
+    
+    static int defaultThreads() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    int threads() const {
+        return threads_;
+    }
+    
+    const std::vector<Tile>& tiles() const {
+        return tiles_;
+    }
+    
+    // Calls job(tile, worker) exactly once for every tile
+    template<class Job>
+    void run(Job job) {
+        if (threads_ == 1) {
+            for (size_t i = 0; i < tiles_.size(); ++i) {
+                job(tiles_[i], 0);
+            }
+            return;
+        }
+        
+        std::vector<Queue> queues(threads_);
+        for (int worker = 0; worker < threads_; ++worker) {
+            size_t begin = tiles_.size() * worker / threads_;
+            size_t end = tiles_.size() * (worker + 1) / threads_;
+            for (size_t i = begin; i < end; ++i) {
+                queues[worker].tiles.push_back(i);
+            }
+        }
+        
+        std::vector<std::thread> pool;
+        for (int worker = 1; worker < threads_; ++worker) {
+            pool.push_back(std::thread(&TileScheduler::work<Job>, this, worker, std::ref(queues), std::ref(job)));
+        }
+        work(0, queues, job);
+        
+        for (size_t i = 0; i < pool.size(); ++i) {
+            pool[i].join();
+        }
+    }
+    
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tiles;
+    };
+    
+    int threads_;
+    std::vector<Tile> tiles_;
+    
+    template<class Job>
+    void work(int worker, std::vector<Queue>& queues, Job& job) {
+        size_t tile;
+        while (pop(&queues[worker], &tile) || steal(worker, queues, &tile)) {
+            job(tiles_[tile], worker);
+        }
+    }
+    
+    static bool pop(Queue* queue, size_t* tile) {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        if (queue->tiles.empty()) {
+            return false;
+        }
+        *tile = queue->tiles.front();
+        queue->tiles.pop_front();
+        return true;
+    }
+    
+    // Tiles are never added after start, so an empty sweep means we are done
+    bool steal(int worker, std::vector<Queue>& queues, size_t* tile) {
+        for (int i = 1; i < threads_; ++i) {
+            Queue& victim = queues[(worker + i) % threads_];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tiles.empty()) {
+                *tile = victim.tiles.back();
+                victim.tiles.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif /* tile_scheduler_h */
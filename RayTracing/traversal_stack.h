@@ -0,0 +1,61 @@
+//
+//  traversal_stack.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef traversal_stack_h
+#define traversal_stack_h
+
+#include <cassert>
+
+// Levels of inner nodes a traversal has to handle. The builders stop
+// splitting there and load() rejects deeper cached trees, so every inner node
+// lies less than TRAVERSAL_DEPTH levels below the root and the stacks sized
+// from it never overflow.
+const int TRAVERSAL_DEPTH = 64;
+
+// Stack of the nodes a traversal has still to visit. It lives in the frame
+// of the traversal, so a ray allocates nothing and the threads share nothing.
+// A binary tree walk keeps at most one entry per level, the capacity follows
+// from TRAVERSAL_DEPTH. Checked in debug builds only, the trees are bounded
+// when they are built or loaded.
+template<class Entry, int CAPACITY>
+class TraversalStack {
+public:
+    TraversalStack() : size_(0) { }
+    
+    bool empty() const {
+        return size_ == 0;
+    }
+    
+    void push(const Entry& entry) {
+        assert(size_ < CAPACITY);
+        entries_[size_++] = entry;
+    }
+    
+    // The first of the entries ends up at the bottom
+    void push(const Entry* entries, int count) {
+        for (int i = 0; i < count; ++i) {
+            push(entries[i]);
+        }
+    }
+    
+    const Entry& top() const {
+        assert(size_ > 0);
+        return entries_[size_ - 1];
+    }
+    
+    Entry pop() {
+        assert(size_ > 0);
+        return entries_[--size_];
+    }
+    
+private:
+    Entry entries_[CAPACITY];
+    int size_;
+};
+
+#endif /* traversal_stack_h */
@@ -0,0 +1,227 @@
+//
+//  triangle_mesh.h
+//  RayTracing
+//
+//  Created by wheeltune on 17.10.26.
+//  Copyright © 2026 wheeltune. All rights reserved.
+//
+
+#ifndef triangle_mesh_h
+#define triangle_mesh_h
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "object3d.h"
+
+class TriangleMesh;
+
+// One triangle of a TriangleMesh: a pointer to the mesh and an index, the
+// vertices and normals stay in the shared arrays of the mesh
+class MeshTriangle : public Object3D {
+public:
+    MeshTriangle(const TriangleMesh* mesh, uint32_t index, uint32_t material) : Object3D(material), index_(index),
+    mesh_(mesh) { }
+    
+    virtual bool intersect(Geometry::Ray* ray) const;
+    virtual void intersectPacket(RayPacket* packet, const Geometry::Real* tMin, const Geometry::Real* tMax,
+                                 const bool* active) const;
+    virtual bool occludes(const Geometry::Ray& ray) const;
+                          
+    // Interpolated vertex normal if the mesh has normals, the face normal otherwise
+    virtual Geometry::Point3D normalAt(const Geometry::Point3D& point) const;
+    
+    virtual BoundingBox boundingBox() const;
+    virtual bool clippedBoundingBox(const BoundingBox& voxel, BoundingBox* bBox) const;
+    
+private:
+    uint32_t index_;                // next to the material id, a triangle takes three words
+    const TriangleMesh* mesh_;
+    
+    // Geometry::crossTriangle over the vertices of the mesh
+    bool cross(const Geometry::Point3D& start, const Geometry::RayShear& shear, Geometry::Real* t,
+               Geometry::Real* u, Geometry::Real* v) const;
+};
+
+// Triangles over shared vertex, normal and material arrays. A triangle is
+// three vertex indices, optionally three normal indices, and a material
+// index. finish() creates all MeshTriangle objects in one array, they are
+// what RayTracer hands to the acceleration structures. Until then material
+// indices count in the materials of the mesh, RayTracer::addMesh() moves
+// them to the table of the scene.
+class TriangleMesh {
+public:
+    static const uint32_t NO_NORMALS = 0xFFFFFFFF;
+    
+    TriangleMesh() { }
+    
+    // The triangles point to the mesh, so it stays where it was made
+    TriangleMesh(const TriangleMesh&) = delete;
+    TriangleMesh& operator =(const TriangleMesh&) = delete;
+    
+    uint32_t addVertex(const Geometry::Point3D& vertex) {
+        vertices_.push_back(vertex);
+        return (uint32_t) vertices_.size() - 1;
+    }
+    
+    uint32_t addNormal(const Geometry::Point3D& normal) {
+        normals_.push_back(normal);
+        return (uint32_t) normals_.size() - 1;
+    }
+    
+    uint32_t addMaterial(const Material& material) {
+        materials_.push_back(material);
+        return (uint32_t) materials_.size() - 1;
+    }
+    
+    // The indices must refer to added vertices, normals and materials
+    void addTriangle(const uint32_t vertices[3], uint32_t material, const uint32_t* normals = NULL) {
+        assert(triangles_.empty());
+        for (int k = 0; k < 3; ++k) {
+            assert(vertices[k] < vertices_.size());
+            indices_.push_back(vertices[k]);
+            uint32_t normal = normals != NULL ? normals[k] : NO_NORMALS;
+            normalIndices_.push_back(normal);
+        }
+        assert(material < materials_.size());
+        materialIds_.push_back(material);
+    }
+    
+    // Creates the triangle objects, no triangles can be added after it. Runs
+    // once per mesh: the objects are handed out by pointer and must not move.
+    void finish() {
+        assert(triangles_.empty());
+        triangles_.reserve(materialIds_.size());
+        for (uint32_t i = 0; i < materialIds_.size(); ++i) {
+            triangles_.push_back(MeshTriangle(this, i, materialIds_[i]));
+        }
+    }
+    
+    size_t triangleCount() const {
+        return materialIds_.size();
+    }
+    
+    size_t vertexCount() const {
+        return vertices_.size();
+    }
+    
+    size_t normalCount() const {
+        return normals_.size();
+    }
+    
+    // Valid after finish()
+    MeshTriangle* triangle(size_t index) {
+        return &triangles_[index];
+    }
+    
+    const Geometry::Point3D& vertex(uint32_t triangle, int corner) const {
+        return vertices_[indices_[3 * triangle + corner]];
+    }
+    
+    bool hasNormals(uint32_t triangle) const {
+        return normalIndices_[3 * triangle] != NO_NORMALS;
+    }
+    
+    const Geometry::Point3D& normal(uint32_t triangle, int corner) const {
+        return normals_[normalIndices_[3 * triangle + corner]];
+    }
+    
+    const std::vector<Material>& materials() const {
+        return materials_;
+    }
+    
+    size_t memoryUsage() const {
+        return vertices_.capacity() * sizeof(Geometry::Point3D) + normals_.capacity() * sizeof(Geometry::Point3D) +
+               (indices_.capacity() + normalIndices_.capacity() + materialIds_.capacity()) * sizeof(uint32_t) +
+               materials_.capacity() * sizeof(Material) + triangles_.capacity() * sizeof(MeshTriangle);
+    }
+    
+private:
+    std::vector<Geometry::Point3D> vertices_;
+    std::vector<Geometry::Point3D> normals_;
+    std::vector<uint32_t> indices_;             // three per triangle
+    std::vector<uint32_t> normalIndices_;       // three per triangle, NO_NORMALS if it has none
+    std::vector<uint32_t> materialIds_;         // one per triangle
+    std::vector<Material> materials_;
+    std::vector<MeshTriangle> triangles_;
+};
+
+bool MeshTriangle::cross(const Geometry::Point3D& start, const Geometry::RayShear& shear, Geometry::Real* t,
+                         Geometry::Real* u, Geometry::Real* v) const {
+    return Geometry::crossTriangle(start, shear, mesh_->vertex(index_, 0), mesh_->vertex(index_, 1),
+                                   mesh_->vertex(index_, 2), t, u, v);
+}
+
+bool MeshTriangle::intersect(Geometry::Ray* ray) const {
+    Geometry::Real t, u, v;
+    if (!cross(ray->origin, ray->shear, &t, &u, &v) || t < ray->tMin || t >= ray->tMax) {
+        return false;
+    }
+    ray->tMax = t;
+    return true;
+}
+
+void MeshTriangle::intersectPacket(RayPacket* packet, const Geometry::Real* tMin, const Geometry::Real* tMax,
+                                   const bool* active) const {
+    const Geometry::Point3D& a = mesh_->vertex(index_, 0);
+    const Geometry::Point3D& b = mesh_->vertex(index_, 1);
+    const Geometry::Point3D& c = mesh_->vertex(index_, 2);
+    
+    Geometry::Real U[RayPacket::SIZE], V[RayPacket::SIZE], W[RayPacket::SIZE];
+    bool hit[RayPacket::SIZE];
+    packet->triangleEdges(a, b, c, active, U, V, W, hit);
+    
+    // The distance as in Geometry::crossTriangle
+    const Geometry::Real* oz = packet->o[packet->kz];
+    for (int i = 0; i < RayPacket::SIZE; ++i) {
+        Geometry::Real det = U[i] + V[i] + W[i];
+        Geometry::Real T = (U[i] * (a[packet->kz] - oz[i]) + V[i] * (b[packet->kz] - oz[i]) +
+                            W[i] * (c[packet->kz] - oz[i])) * packet->sz[i];
+        Geometry::Real t = T / det;
+        bool closer = hit[i] & (t >= tMin[i] - Geometry::EPS) & (t <= tMax[i] + Geometry::EPS) & (t < packet->t[i]);
+        packet->t[i] = closer ? t : packet->t[i];
+        packet->object[i] = closer ? this : packet->object[i];
+    }
+}
+
+bool MeshTriangle::occludes(const Geometry::Ray& ray) const {
+    Geometry::Real t, u, v;
+    return cross(ray.origin, ray.shear, &t, &u, &v) && t >= ray.tMin && t <= ray.tMax;
+}
+
+Geometry::Point3D MeshTriangle::normalAt(const Geometry::Point3D& point) const {
+    const Geometry::Point3D& p0 = mesh_->vertex(index_, 0);
+    Geometry::Point3D e1 = mesh_->vertex(index_, 1) - p0;
+    Geometry::Point3D e2 = mesh_->vertex(index_, 2) - p0;
+    if (!mesh_->hasNormals(index_)) {
+        return (e1 ^ e2).normalize();
+    }
+    
+    // Barycentrics of the point from the dot products of the edges
+    Geometry::Point3D w = point - p0;
+    Geometry::Real d11 = e1 * e1, d12 = e1 * e2, d22 = e2 * e2;
+    Geometry::Real w1 = w * e1, w2 = w * e2;
+    Geometry::Real det = d11 * d22 - d12 * d12;
+    Geometry::Real u = (d22 * w1 - d12 * w2) / det;
+    Geometry::Real v = (d11 * w2 - d12 * w1) / det;
+    
+    Geometry::Point3D normal = mesh_->normal(index_, 0) * (1 - u - v) + mesh_->normal(index_, 1) * u +
+                               mesh_->normal(index_, 2) * v;
+    return normal.normalize();
+}
+
+BoundingBox MeshTriangle::boundingBox() const {
+    BoundingBox bBox(mesh_->vertex(index_, 0), mesh_->vertex(index_, 0));
+    for (int k = 1; k < 3; ++k) {
+        bBox.expand(BoundingBox(mesh_->vertex(index_, k), mesh_->vertex(index_, k)));
+    }
+    return bBox;
+}
+
+bool MeshTriangle::clippedBoundingBox(const BoundingBox& voxel, BoundingBox* bBox) const {
+    Geometry::Point3D points[3] = {mesh_->vertex(index_, 0), mesh_->vertex(index_, 1), mesh_->vertex(index_, 2)};
+    return clippedPolygonBox(points, 3, voxel, bBox);
+}
+
+#endif /* triangle_mesh_h */
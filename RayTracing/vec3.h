@@ -15,16 +15,16 @@
 
 namespace Geometry {
     struct Vec3 {
-        long double vec[3];
+        Real vec[3];
         
-        Vec3(long double v1, long double v2, long double v3);
-        Vec3(long double v) : Vec3(v, v, v) { };
+        Vec3(Real v1, Real v2, Real v3);
+        Vec3(Real v) : Vec3(v, v, v) { };
         Vec3() { }
         
-        Vec3 limit(long double down, long double up);
+        Vec3 limit(Real down, Real up);
         
-        long double& operator[] (int index);
-        const long double operator[]  (int index) const;
+        Real& operator[] (int index);
+        const Real operator[]  (int index) const;
         
         Vec3& operator +=(const Vec3& v);
         Vec3& operator *=(const Vec3& v);
@@ -38,17 +38,17 @@ namespace Geometry {
         Vec3& operator /=(float k);
     };
     
-    Vec3::Vec3(long double v1, long double v2, long double v3) {
+    Vec3::Vec3(Real v1, Real v2, Real v3) {
         vec[0] = v1;
         vec[1] = v2;
         vec[2] = v3;
     }
     
-    long double& Vec3::operator[] (int index) {
+    Real& Vec3::operator[] (int index) {
         return vec[index];
     }
     
-    const long double Vec3::operator[] (int index) const {
+    const Real Vec3::operator[] (int index) const {
         return vec[index];
     }
     Vec3& Vec3::operator+=(const Vec3& v) {
@@ -124,7 +124,7 @@ namespace Geometry {
     }
     
     
-    Vec3 Vec3::limit(long double down, long double up) {
+    Vec3 Vec3::limit(Real down, Real up) {
         Vec3 ans;
         for (int i = 0; i < 3; ++i) {
             ans[i] = std::max(std::min(vec[i], up), down);
@@ -9,14 +9,18 @@
 #ifndef Window_h
 #define Window_h
 #include <cmath>
+#include <utility>
+#include <vector>
 #include <SDL2/sdl.h>
 #include "geometry.h"
+#include "framebuffer.h"
 
 using namespace Geometry;
 
 class Window {
 public:
-    Window() { }
+    Window() : leftTop_(0, 0, 0), rightTop_(0, 0, 0), leftBottom_(0, 0, 0), rightBottom_(0, 0, 0),
+               window_(NULL), renderer_(NULL), texture_(NULL) { }
     Window(
            Point3D leftTop,
            Point3D rightTop,
@@ -24,12 +28,33 @@ public:
            ) : leftTop_(leftTop),
                rightTop_(rightTop),
                leftBottom_(leftBottom),
-               rightBottom_(leftBottom + rightTop - leftTop)
-    {
-        SDL_Init(SDL_INIT_VIDEO);              // Initialize SDL2
+               rightBottom_(leftBottom + rightTop - leftTop),
+               window_(NULL),
+               renderer_(NULL),
+               texture_(NULL) { }
+    
+    // The SDL handles have one owner, moving a window hands them over
+    Window(const Window&) = delete;
+    Window& operator =(const Window&) = delete;
+    
+    Window(Window&& other) : Window() {
+        *this = std::move(other);
     }
-    ~Window() {
-        SDL_Quit();
+    
+    // Closes this window first if it's open
+    Window& operator =(Window&& other) {
+        if (this != &other) {
+            close();
+            leftTop_ = other.leftTop_;
+            rightTop_ = other.rightTop_;
+            leftBottom_ = other.leftBottom_;
+            rightBottom_ = other.rightBottom_;
+            std::swap(window_, other.window_);
+            std::swap(renderer_, other.renderer_);
+            std::swap(texture_, other.texture_);
+            rgba_.swap(other.rgba_);
+        }
+        return *this;
     }
     
     bool open() {
@@ -39,6 +64,12 @@ public:
             return false;
         }
         
+        // SDL is only touched once a window is requested, headless renders never get here
+        if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+            printf("Could not initialize SDL: %s\n", SDL_GetError());
+            return false;
+        }
+        
         // Create an application window with the following settings:
         window_ = SDL_CreateWindow(
                                   "Ray Tracing",                        // window title
@@ -64,26 +95,48 @@ public:
     }
     
     void close() {
+        if (window_ == NULL) {
+            return;
+        }
+        
+        SDL_DestroyTexture(texture_);
+        SDL_DestroyRenderer(renderer_);
         SDL_DestroyWindow(window_);
+        texture_ = NULL;
+        renderer_ = NULL;
         window_ = NULL;
+        
+        SDL_Quit();
     }
     
-    void getPixelPoints(int x, int y, Point3D* points, int allias) {
-        int width = getPixelWidth(), height = getPixelHeight();
-        Point3D xBase = (rightTop_ - leftTop_)   / width / 2;
-        Point3D yBase = (leftBottom_ - leftTop_) / height / 2;
+    bool isOpen() const {
+        return window_ != NULL;
+    }
     
-        points[0] = leftTop_ + xBase * (2 * x + 1) + yBase * (2 * y + 1);
-        for (int i = 1; i < allias; ++i) {
-            points[i] = points[0] + xBase * std::cos(2 * PI * i / allias) + yBase * std::sin(2 * PI * i / allias);
-        }
+    // Pixel (x, y) covers corner + right * [x, x + 1) + down * [y, y + 1)
+    void getPixelGrid(Point3D* corner, Point3D* right, Point3D* down) const {
+        *corner = leftTop_;
+        *right = (rightTop_ - leftTop_) / getPixelWidth();
+        *down = (leftBottom_ - leftTop_) / getPixelHeight();
+    }
+    
+    Point3D leftTop() const {
+        return leftTop_;
+    }
+    
+    Point3D rightTop() const {
+        return rightTop_;
+    }
+    
+    Point3D leftBottom() const {
+        return leftBottom_;
     }
     
-    int getPixelWidth() {
+    int getPixelWidth() const {
         return (int)(leftTop_ - rightTop_).len();
     }
     
-    int getPixelHeight() {
+    int getPixelHeight() const {
         return (int)(leftTop_ - leftBottom_).len();
     }
     
@@ -92,9 +145,28 @@ public:
         return SDL_PollEvent(event);
     }
     
-    void setPixelColor(int x, int y, SDL_Color color) {
-        SDL_SetRenderDrawColor(renderer_, color.r, color.g, color.b, color.a);
-        SDL_RenderDrawPoint(renderer_, x, y);
+    // Uploads the whole frame as one texture and presents it. The texture is
+    // created again when the frame changes its size.
+    void present(const Framebuffer& framebuffer) {
+        int width = 0, height = 0;
+        if (texture_ != NULL && (SDL_QueryTexture(texture_, NULL, NULL, &width, &height) != 0 ||
+                                 width != framebuffer.width() || height != framebuffer.height())) {
+            SDL_DestroyTexture(texture_);
+            texture_ = NULL;
+        }
+        if (texture_ == NULL) {
+            texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+                                         framebuffer.width(), framebuffer.height());
+            if (texture_ == NULL) {
+                printf("Could not create texture: %s\n", SDL_GetError());
+                return;
+            }
+        }
+        
+        framebuffer.toRGBA8(&rgba_);
+        SDL_UpdateTexture(texture_, NULL, rgba_.data(), framebuffer.width() * 4);
+        SDL_RenderCopy(renderer_, texture_, NULL, NULL);
+        flush();
     }
     
     void flush() {
@@ -111,9 +183,11 @@ public:
     }
     
 private:
+    Point3D leftTop_, rightTop_, leftBottom_, rightBottom_;
     SDL_Window* window_;
     SDL_Renderer* renderer_;
-    Point3D leftTop_, rightTop_, leftBottom_, rightBottom_;
+    SDL_Texture* texture_;
+    std::vector<Uint8> rgba_;
 };
 
 #endif /* Window_h */